@@ -0,0 +1,332 @@
+#include "benchmark/benchmark.h"
+#include "AVLTree.h"
+#include "AVLTree.cpp"
+#include <set>
+#include <string>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <utility>
+
+using namespace std;
+using namespace avl;
+
+//AVLTree against std::set for int and string keys drawn from three distributions.
+//run with --benchmark_out=<file> --benchmark_out_format=json, or build the benchmark_json target
+
+enum Distribution{
+    uniform_keys,
+    sorted_keys,
+    zipfian_keys
+};
+
+//zipfian ranks with exponent 0.99 over [0, n), the generator of Gray et al. that needs no table
+class ZipfianGenerator{
+private:
+    double n;
+
+    double theta = 0.99;
+
+    double alpha;
+
+    double zeta_n;
+
+    double eta;
+
+    mt19937_64 random;
+
+    uniform_real_distribution<double> unit;
+
+    //sum of 1 / i^theta for i in [1, n]. the sums of every n asked for are kept, and a new n
+    //extends the largest kept one below it, as Gray et al. do for growing sizes
+    static double zeta(size_t n, double theta){
+        static map<pair<double, size_t>, double> sums;
+        auto next = sums.upper_bound(make_pair(theta, n));
+        size_t first = 1;
+        double sum = 0;
+        if (next != sums.begin() && prev(next)->first.first == theta){
+            first = prev(next)->first.second + 1;
+            sum = prev(next)->second;
+        }
+        for (size_t i = first; i <= n; ++i){
+            sum += 1 / pow(double(i), theta);
+        }
+        sums[make_pair(theta, n)] = sum;
+        return sum;
+    }
+
+public:
+    ZipfianGenerator(size_t n, uint64_t seed)
+            :n(double(n))
+            ,alpha(1 / (1 - theta))
+            ,zeta_n(zeta(n, theta))
+            ,eta((1 - pow(2 / double(n), 1 - theta)) / (1 - zeta(2, theta) / zeta_n))
+            ,random(seed){}
+
+    uint64_t operator()(){
+        double u = unit(random);
+        double uz = u * zeta_n;
+        if (uz < 1){
+            return 0;
+        }
+        if (uz < 1 + pow(0.5, theta)){
+            return 1;
+        }
+        return uint64_t(n * pow(eta * u - eta + 1, alpha));
+    }
+};
+
+template<class Key>
+Key makeKey(uint64_t rank);
+
+template<>
+int64_t makeKey<int64_t>(uint64_t rank) { return int64_t(rank); }
+
+//fixed width, so the string order is the numeric one
+template<>
+string makeKey<string>(uint64_t rank){
+    string digits = to_string(rank);
+    return "key:" + string(20 - digits.size(), '0') + digits;
+}
+
+//the keys of a run, only those of the last size and distribution are kept
+template<class Key>
+const vector<Key> &keys(size_t n, Distribution distribution){
+    static vector<Key> result;
+    static pair<size_t, Distribution> cached(0, uniform_keys);
+    if (cached == make_pair(n, distribution) && result.size() == n){
+        return result;
+    }
+
+    cached = make_pair(n, distribution);
+    vector<Key>().swap(result);
+    mt19937_64 random(n);
+    result.reserve(n);
+    if (distribution == zipfian_keys){
+        ZipfianGenerator zipfian(n, n);
+        //ranks are scattered over the key space, so the hot keys are not the smallest ones
+        for (size_t i = 0; i < n; ++i){
+            result.push_back(makeKey<Key>(zipfian() * 0x9e3779b97f4a7c15ULL % (4 * n)));
+        }
+        return result;
+    }
+
+    for (size_t i = 0; i < n; ++i){
+        result.push_back(makeKey<Key>(random() % (4 * n)));
+    }
+    if (distribution == sorted_keys){
+        sort(result.begin(), result.end());
+    }
+    return result;
+}
+
+//lookups of present keys in random order
+template<class Key>
+vector<Key> probes(const vector<Key> &keys){
+    vector<Key> result(keys);
+    shuffle(result.begin(), result.end(), mt19937_64(1));
+    return result;
+}
+
+template<class Set>
+struct KeyType;
+
+template<class Key>
+struct KeyType<AVLTree<Key>>{
+    using type = Key;
+};
+
+template<class Key>
+struct KeyType<set<Key>>{
+    using type = Key;
+};
+
+template<class Set>
+using KeyOf = typename KeyType<Set>::type;
+
+template<class Key>
+bool insertKey(AVLTree<Key> &tree, const Key &key) { return tree.insert(key); }
+
+template<class Key>
+bool insertKey(set<Key> &set, const Key &key) { return set.insert(key).second; }
+
+template<class Key>
+bool containsKey(const AVLTree<Key> &tree, const Key &key) { return tree.contains(key); }
+
+template<class Key>
+bool containsKey(const set<Key> &set, const Key &key) { return set.count(key) > 0; }
+
+template<class Key>
+bool eraseKey(AVLTree<Key> &tree, const Key &key) { return tree.deleteIfExists(key); }
+
+template<class Key>
+bool eraseKey(set<Key> &set, const Key &key) { return set.erase(key) > 0; }
+
+template<class Set>
+Set build(const vector<KeyOf<Set>> &keys){
+    Set result;
+    for (auto &key : keys){
+        insertKey(result, key);
+    }
+    return result;
+}
+
+//both halves of the set, returned so the benchmark joins them back with the timer paused
+template<class Key>
+pair<AVLTree<Key>, AVLTree<Key>> splitAt(AVLTree<Key> &tree, const Key &key) { return AVLTree<Key>::split(tree, key, true); }
+
+template<class Key>
+pair<set<Key>, set<Key>> splitAt(set<Key> &set, const Key &key){
+    std::set<Key> upper(set.lower_bound(key), set.end());
+    set.erase(set.lower_bound(key), set.end());
+    return make_pair(std::move(set), std::move(upper));
+}
+
+//the set before splitAt, every value of the second half is greater than those of the first
+template<class Key>
+AVLTree<Key> joinBack(pair<AVLTree<Key>, AVLTree<Key>> &&halves){
+    halves.first.uniteWith(std::move(halves.second));
+    return std::move(halves.first);
+}
+
+template<class Key>
+set<Key> joinBack(pair<set<Key>, set<Key>> &&halves){
+    halves.first.insert(halves.second.begin(), halves.second.end());
+    halves.second.clear();
+    return std::move(halves.first);
+}
+
+template<class Key>
+size_t unite(const AVLTree<Key> &first, const AVLTree<Key> &second) { return setUnion(first, second).size(); }
+
+template<class Key>
+size_t unite(const set<Key> &first, const set<Key> &second){
+    set<Key> result;
+    set_union(first.begin(), first.end(), second.begin(), second.end(), inserter(result, result.end()));
+    return result.size();
+}
+
+template<class Set>
+void BM_Insert(benchmark::State &state){
+    auto &values = keys<KeyOf<Set>>(state.range(0), Distribution(state.range(1)));
+    for (auto _ : state){
+        Set set;
+        for (auto &value : values){
+            benchmark::DoNotOptimize(insertKey(set, value));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * values.size());
+}
+
+template<class Set>
+void BM_Find(benchmark::State &state){
+    auto &values = keys<KeyOf<Set>>(state.range(0), Distribution(state.range(1)));
+    auto set = build<Set>(values);
+    auto lookups = probes(values);
+    for (auto _ : state){
+        for (auto &value : lookups){
+            benchmark::DoNotOptimize(containsKey(set, value));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * lookups.size());
+}
+
+template<class Set>
+void BM_Delete(benchmark::State &state){
+    auto &values = keys<KeyOf<Set>>(state.range(0), Distribution(state.range(1)));
+    auto source = build<Set>(values);
+    auto deletions = probes(values);
+    for (auto _ : state){
+        state.PauseTiming();
+        Set set(source);
+        state.ResumeTiming();
+        for (auto &value : deletions){
+            benchmark::DoNotOptimize(eraseKey(set, value));
+        }
+        state.PauseTiming();
+        set = Set();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * deletions.size());
+}
+
+template<class Set>
+void BM_Iterate(benchmark::State &state){
+    auto set = build<Set>(keys<KeyOf<Set>>(state.range(0), Distribution(state.range(1))));
+    for (auto _ : state){
+        for (auto &value : set){
+            benchmark::DoNotOptimize(&value);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * set.size());
+}
+
+template<class Set>
+void BM_Copy(benchmark::State &state){
+    auto set = build<Set>(keys<KeyOf<Set>>(state.range(0), Distribution(state.range(1))));
+    for (auto _ : state){
+        Set copy(set);
+        benchmark::DoNotOptimize(copy.size());
+    }
+    state.SetItemsProcessed(state.iterations() * set.size());
+}
+
+template<class Set>
+void BM_Split(benchmark::State &state){
+    auto &values = keys<KeyOf<Set>>(state.range(0), Distribution(state.range(1)));
+    auto set = build<Set>(values);
+    auto middle = values[values.size() / 2];
+    for (auto _ : state){
+        auto halves = splitAt(set, middle);
+        benchmark::DoNotOptimize(&halves);
+        state.PauseTiming();
+        set = joinBack(std::move(halves));
+        state.ResumeTiming();
+    }
+}
+
+//union with a set of the same size and distribution
+template<class Set>
+void BM_Union(benchmark::State &state){
+    size_t n = state.range(0);
+    auto &values = keys<KeyOf<Set>>(n, Distribution(state.range(1)));
+    auto first = build<Set>(vector<KeyOf<Set>>(values.begin(), values.begin() + n / 2));
+    auto second = build<Set>(vector<KeyOf<Set>>(values.begin() + n / 2, values.end()));
+    for (auto _ : state){
+        benchmark::DoNotOptimize(unite(first, second));
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+//sizes from 1K in steps of 10 for every distribution
+void sizesAndDistributions(benchmark::internal::Benchmark *benchmark){
+    benchmark->ArgNames({"n", "distribution"})->Unit(benchmark::kMillisecond);
+    for (int64_t n = 1000; n <= int64_t(BENCHMARK_MAX_SIZE); n *= 10){
+        for (int distribution : {uniform_keys, sorted_keys, zipfian_keys}){
+            benchmark->Args({n, distribution});
+        }
+    }
+}
+
+#define SET_BENCHMARKS(Key) \
+    BENCHMARK_TEMPLATE(BM_Insert, AVLTree<Key>)->Apply(sizesAndDistributions); \
+    BENCHMARK_TEMPLATE(BM_Insert, set<Key>)->Apply(sizesAndDistributions); \
+    BENCHMARK_TEMPLATE(BM_Find, AVLTree<Key>)->Apply(sizesAndDistributions); \
+    BENCHMARK_TEMPLATE(BM_Find, set<Key>)->Apply(sizesAndDistributions); \
+    BENCHMARK_TEMPLATE(BM_Delete, AVLTree<Key>)->Apply(sizesAndDistributions); \
+    BENCHMARK_TEMPLATE(BM_Delete, set<Key>)->Apply(sizesAndDistributions); \
+    BENCHMARK_TEMPLATE(BM_Iterate, AVLTree<Key>)->Apply(sizesAndDistributions); \
+    BENCHMARK_TEMPLATE(BM_Iterate, set<Key>)->Apply(sizesAndDistributions); \
+    BENCHMARK_TEMPLATE(BM_Copy, AVLTree<Key>)->Apply(sizesAndDistributions); \
+    BENCHMARK_TEMPLATE(BM_Copy, set<Key>)->Apply(sizesAndDistributions); \
+    BENCHMARK_TEMPLATE(BM_Split, AVLTree<Key>)->Apply(sizesAndDistributions); \
+    BENCHMARK_TEMPLATE(BM_Split, set<Key>)->Apply(sizesAndDistributions); \
+    BENCHMARK_TEMPLATE(BM_Union, AVLTree<Key>)->Apply(sizesAndDistributions); \
+    BENCHMARK_TEMPLATE(BM_Union, set<Key>)->Apply(sizesAndDistributions)
+
+SET_BENCHMARKS(int64_t);
+SET_BENCHMARKS(string);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,28 @@
+#include "AVLMap.h"
+
+using namespace std;
+using namespace avl;
+
+template<class K, class V, class TAggregate, class TCompare>
+const V *AVLMap<K, V, TAggregate, TCompare>::find(const K &key) const {
+    auto entry = tree.find(key);
+    return entry ? &entry->second : nullptr;
+}
+
+template<class K, class V, class TAggregate, class TCompare>
+bool AVLMap<K, V, TAggregate, TCompare>::insertOrAssign(const K &key, V value) {
+    tree.beginUpdate();
+    typename Tree::SearchPath path;
+    auto node = tree.descend(tree.root, key, path);
+    if (!node){
+        tree.root = tree.ascend(path, tree.createNode(Entry(key, std::move(value))));
+        return true;
+    }
+
+    //the aggregates on the path are recomputed on the way up
+    node = tree.own(node);
+    node->value.second = std::move(value);
+    node->updateSize();
+    tree.root = tree.ascend(path, node);
+    return false;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <utility>
+#include <functional>
+#include <type_traits>
+
+#include "AVLTree.h"
+
+namespace avl{
+    //ordered map on top of AVLTree, TAggregate from Aggregate.h is lifted from the mapped values
+    //and kept for every subtree through rotations, splits and joins
+    template<class K, class V, class TAggregate = NoAggregate, class TCompare = std::less<K>>
+    class AVLMap {
+    private:
+        using Entry = std::pair<K, V>;
+
+        //orders entries by key, keys can be looked up without building an entry
+        struct EntryCompare{
+            using is_transparent = void;
+
+            TCompare cmp;
+
+            bool operator()(const Entry &first, const Entry &second) const { return cmp(first.first, second.first); }
+
+            bool operator()(const Entry &first, const K &second) const { return cmp(first.first, second); }
+
+            bool operator()(const K &first, const Entry &second) const { return cmp(first, second.first); }
+
+            bool operator()(const K &first, const K &second) const { return cmp(first, second); }
+        };
+
+        struct EntryAggregate{
+            using value_type = typename TAggregate::value_type;
+
+            static value_type identity() { return TAggregate::identity(); }
+
+            static value_type combine(const value_type &left, const value_type &right) { return TAggregate::combine(left, right); }
+
+            static value_type lift(const Entry &entry) { return TAggregate::lift(entry.second); }
+        };
+
+        using Tree = AVLTree<Entry, EntryCompare,
+                typename std::conditional<std::is_same<TAggregate, NoAggregate>::value, NoAggregate, EntryAggregate>::type>;
+
+        Tree tree;
+
+        explicit AVLMap(Tree &&tree) : tree(std::move(tree)) {}
+
+    public:
+        using iterator = typename Tree::iterator;
+
+        using const_iterator = typename Tree::const_iterator;
+
+        explicit AVLMap(const TCompare &cmp = TCompare()) : tree(EntryCompare{cmp}) {}
+
+        size_t size() const { return tree.size(); }
+
+        size_t height() const { return tree.height(); }
+
+        bool contains(const K &key) const { return tree.contains(key); }
+
+        //mapped value of key, nullptr if there is none
+        const V *find(const K &key) const;
+
+        //returns false and keeps the old value if key is present
+        bool insert(const K &key, const V &value) { return tree.emplace(key, value); }
+
+        //returns true if key was not present
+        bool insertOrAssign(const K &key, V value);
+
+        bool erase(const K &key) { return tree.deleteIfExists(key); }
+
+        //combined aggregate of the values with keys in [lo, hi] in key order, O(log n)
+        template<class A = TAggregate>
+        typename A::value_type aggregate(const K &lo, const K &hi) const {
+            return Tree::aggregateRange(tree.root, lo, hi, tree.cmp);
+        }
+
+        //aggregate of all values, O(1)
+        template<class A = TAggregate>
+        typename A::value_type aggregate() const { return tree.aggregate(); }
+
+        //entries with keys in [lo, hi] are removed or moved out in O(log n)
+        void eraseRange(const K &lo, const K &hi) { tree.eraseRange(lo, hi); }
+
+        //the extracted map shares the node pool of this one, see AVLTree::extractRange
+        AVLMap extractRange(const K &lo, const K &hi) { return AVLMap(tree.extractRange(lo, hi)); }
+
+        //in key order, entries are std::pair<K, V>
+        const_iterator begin() const { return tree.begin(); }
+
+        const_iterator end() const { return tree.end(); }
+    };
+}
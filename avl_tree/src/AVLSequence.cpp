@@ -0,0 +1,436 @@
+#include "AVLSequence.h"
+
+using namespace std;
+using namespace avl;
+
+template<typename T>
+void AVLSequence<T>::Node::update() {
+    subtree_height = 1 + std::max(heightOf(left_child), heightOf(right_child));
+    subtree_size = 1 + sizeOf(left_child) + sizeOf(right_child);
+}
+
+template<typename T>
+AVLSequence<T>::AVLSequence(Node *root, const std::shared_ptr<Pool> &pool)
+        :pool(pool)
+        ,root(root){}
+
+template<typename T>
+AVLSequence<T>::AVLSequence(const vector<T> &elements){
+    if (!elements.empty()){
+        pool = make_shared<Pool>();
+        root = buildBalanced(elements.begin(), elements.size());
+    }
+}
+
+template<typename T>
+AVLSequence<T>::AVLSequence(const initializer_list<T> &il)
+        :AVLSequence(vector<T>(il)){}
+
+template<typename T>
+AVLSequence<T>::AVLSequence(const AVLSequence &other){
+    if (other.root){
+        pool = make_shared<Pool>();
+        root = copySubtree(other.root, *pool);
+    }
+}
+
+template<typename T>
+AVLSequence<T>::AVLSequence(AVLSequence &&other) noexcept
+        :pool(std::move(other.pool))
+        ,root(other.root){
+    other.root = nullptr;
+}
+
+template<typename T>
+AVLSequence<T> &AVLSequence<T>::operator=(const AVLSequence &other) {
+    if (this != &other){
+        AVLSequence tmp(other);
+        std::swap(pool, tmp.pool);
+        std::swap(root, tmp.root);
+    }
+    return *this;
+}
+
+template<typename T>
+AVLSequence<T> &AVLSequence<T>::operator=(AVLSequence &&other) noexcept {
+    if (this != &other){
+        clear();
+        pool = std::move(other.pool);
+        root = other.root;
+        other.root = nullptr;
+    }
+    return *this;
+}
+
+template<typename T>
+AVLSequence<T>::~AVLSequence() {
+    clear();
+}
+
+template<typename T>
+void AVLSequence<T>::clear() {
+    if (root){
+        pool->destroyLater(root);
+        root = nullptr;
+    }
+    pool.reset();
+}
+
+//applies the tags of node to itself and hands them to its children
+template<typename T>
+void AVLSequence<T>::push(Node *node) {
+    if (node->reversed){
+        std::swap(node->left_child, node->right_child);
+        if (node->left_child){
+            node->left_child->reversed = !node->left_child->reversed;
+        }
+        if (node->right_child){
+            node->right_child->reversed = !node->right_child->reversed;
+        }
+        node->reversed = false;
+    }
+
+    if (node->hasPendingAdd()){
+        node->applyTo(node->value);
+        if (node->left_child){
+            node->left_child->collect(*node);
+        }
+        if (node->right_child){
+            node->right_child->collect(*node);
+        }
+        node->resetPending();
+    }
+}
+
+//k2 is expected to be pushed
+template<typename T>
+typename AVLSequence<T>::Node *AVLSequence<T>::leftRotate(Node *k2) {
+    Node *k1 = k2->right_child;
+    push(k1);
+    k2->right_child = k1->left_child;
+    k1->left_child = k2;
+    k2->update();
+    k1->update();
+    return k1;
+}
+
+template<typename T>
+typename AVLSequence<T>::Node *AVLSequence<T>::rightRotate(Node *k2) {
+    Node *k1 = k2->left_child;
+    push(k1);
+    k2->left_child = k1->right_child;
+    k1->right_child = k2;
+    k2->update();
+    k1->update();
+    return k1;
+}
+
+//subtree_root is expected to be pushed, its subtrees to differ in height by at most 2
+template<typename T>
+typename AVLSequence<T>::Node *AVLSequence<T>::recoverBalance(Node *subtree_root) {
+    int diff = int(heightOf(subtree_root->left_child)) - int(heightOf(subtree_root->right_child));
+    if (diff > 1){
+        auto child = subtree_root->left_child;
+        push(child);
+        if (heightOf(child->left_child) < heightOf(child->right_child)){
+            subtree_root->left_child = leftRotate(child);
+        }
+        return rightRotate(subtree_root);
+    }
+    if (diff < -1){
+        auto child = subtree_root->right_child;
+        push(child);
+        if (heightOf(child->right_child) < heightOf(child->left_child)){
+            subtree_root->right_child = rightRotate(child);
+        }
+        return leftRotate(subtree_root);
+    }
+
+    subtree_root->update();
+    return subtree_root;
+}
+
+//joins left, the detached subtree_root and right in this order
+template<typename T>
+typename AVLSequence<T>::Node *AVLSequence<T>::mergeWithRootAndBalance(Node *left, Node *right, Node *subtree_root) {
+    int diff = int(heightOf(left)) - int(heightOf(right));
+    if (diff > 1){
+        push(left);
+        left->right_child = mergeWithRootAndBalance(left->right_child, right, subtree_root);
+        return recoverBalance(left);
+    }
+    if (diff < -1){
+        push(right);
+        right->left_child = mergeWithRootAndBalance(left, right->left_child, subtree_root);
+        return recoverBalance(right);
+    }
+
+    subtree_root->left_child = left;
+    subtree_root->right_child = right;
+    subtree_root->update();
+    return subtree_root;
+}
+
+template<typename T>
+typename AVLSequence<T>::Node *AVLSequence<T>::merge(Node *left, Node *right) {
+    if (!left){
+        return right;
+    }
+    if (!right){
+        return left;
+    }
+
+    auto nodes = extractFirst(right);
+    return mergeWithRootAndBalance(left, nodes.first, nodes.second);
+}
+
+//returns the rest of the subtree and its first node, detached and pushed
+template<typename T>
+pair<typename AVLSequence<T>::Node *, typename AVLSequence<T>::Node *> AVLSequence<T>::extractFirst(Node *subtree_root) {
+    push(subtree_root);
+    if (!subtree_root->left_child){
+        auto rest = subtree_root->right_child;
+        subtree_root->right_child = nullptr;
+        subtree_root->update();
+        return std::make_pair(rest, subtree_root);
+    }
+
+    auto nodes = extractFirst(subtree_root->left_child);
+    subtree_root->left_child = nodes.first;
+    return std::make_pair(recoverBalance(subtree_root), nodes.second);
+}
+
+//first count values and the rest
+template<typename T>
+pair<typename AVLSequence<T>::Node *, typename AVLSequence<T>::Node *> AVLSequence<T>::split(Node *subtree_root, size_t count) {
+    if (!subtree_root){
+        return std::make_pair(nullptr, nullptr);
+    }
+
+    push(subtree_root);
+    auto left = subtree_root->left_child;
+    auto right = subtree_root->right_child;
+    size_t left_size = sizeOf(left);
+    if (count <= left_size){
+        auto nodes = split(left, count);
+        return std::make_pair(nodes.first, mergeWithRootAndBalance(nodes.second, right, subtree_root));
+    }
+
+    auto nodes = split(right, count - left_size - 1);
+    return std::make_pair(mergeWithRootAndBalance(left, nodes.first, subtree_root), nodes.second);
+}
+
+template<typename T>
+typename AVLSequence<T>::Node *AVLSequence<T>::copySubtree(const Node *subtree_root, Pool &pool) {
+    if (!subtree_root){
+        return nullptr;
+    }
+
+    auto copy = pool.create(*subtree_root);
+    copy->left_child = copySubtree(subtree_root->left_child, pool);
+    copy->right_child = copySubtree(subtree_root->right_child, pool);
+    return copy;
+}
+
+//in-order walk that applies the tags of the ancestors without pushing them
+template<typename T>
+void AVLSequence<T>::collect(const Node *subtree_root, bool reversed, PendingAdd<T> pending, vector<T> &array) {
+    if (!subtree_root){
+        return;
+    }
+
+    reversed = reversed != subtree_root->reversed;
+    pending.collect(*subtree_root);
+    auto first = reversed ? subtree_root->right_child : subtree_root->left_child;
+    auto second = reversed ? subtree_root->left_child : subtree_root->right_child;
+    collect(first, reversed, pending, array);
+    array.push_back(subtree_root->value);
+    pending.applyTo(array.back());
+    collect(second, reversed, pending, array);
+}
+
+template<typename T>
+template<class Iterator>
+typename AVLSequence<T>::Node *AVLSequence<T>::buildBalanced(Iterator first, size_t count) {
+    if (count == 0){
+        return nullptr;
+    }
+
+    size_t left_count = count / 2;
+    auto middle = first;
+    std::advance(middle, left_count);
+    auto node = pool->create(*middle);
+    node->left_child = buildBalanced(first, left_count);
+    node->right_child = buildBalanced(std::next(middle), count - left_count - 1);
+    node->update();
+    return node;
+}
+
+template<typename T>
+template<class... Args>
+typename AVLSequence<T>::Node *AVLSequence<T>::createNode(Args&&... args) {
+    if (!pool){
+        pool = make_shared<Pool>();
+    }
+    return pool->create(std::forward<Args>(args)...);
+}
+
+template<typename T>
+typename AVLSequence<T>::Node *AVLSequence<T>::takeNodes(AVLSequence &other) {
+    auto other_root = other.root;
+    if (!other_root){
+        return nullptr;
+    }
+
+    if (!pool){
+        pool = make_shared<Pool>();
+    }
+
+    if (other.pool == pool){
+        other.root = nullptr;
+        return other_root;
+    }
+
+    if (other.pool.use_count() == 1){ //no other sequence lives in other's slabs
+        pool->adopt(std::move(*other.pool));
+        other.pool.reset();
+        other.root = nullptr;
+        return other_root;
+    }
+
+    auto copy = copySubtree(other_root, *pool);
+    other.clear();
+    return copy;
+}
+
+template<typename T>
+void AVLSequence<T>::checkRange(size_t first, size_t last) const {
+    if (first > last || last > size()){
+        throw std::out_of_range("AVLSequence range is out of bounds");
+    }
+}
+
+template<typename T>
+typename AVLSequence<T>::Node *AVLSequence<T>::cut(size_t first, size_t last) {
+    checkRange(first, last);
+    auto outer = split(root, first);
+    auto inner = split(outer.second, last - first);
+    root = merge(outer.first, inner.second);
+    return inner.first;
+}
+
+template<typename T>
+template<class F>
+void AVLSequence<T>::tagRange(size_t first, size_t last, F tag) {
+    checkRange(first, last);
+    auto outer = split(root, first);
+    auto inner = split(outer.second, last - first);
+    if (inner.first){
+        tag(*inner.first);
+    }
+    root = merge(merge(outer.first, inner.first), inner.second);
+}
+
+template<typename T>
+T AVLSequence<T>::at(size_t index) const {
+    if (index >= size()){
+        throw std::out_of_range("AVLSequence index is out of bounds");
+    }
+
+    bool reversed = false;
+    PendingAdd<T> pending;
+    auto node = root;
+    while (true){
+        reversed = reversed != node->reversed;
+        pending.collect(*node);
+        auto first = reversed ? node->right_child : node->left_child;
+        size_t first_size = sizeOf(first);
+        if (index < first_size){
+            node = first;
+        }
+        else if (index == first_size){
+            T value = node->value;
+            pending.applyTo(value);
+            return value;
+        }
+        else{
+            index -= first_size + 1;
+            node = reversed ? node->left_child : node->right_child;
+        }
+    }
+}
+
+template<typename T>
+void AVLSequence<T>::set(size_t index, T value) {
+    if (index >= size()){
+        throw std::out_of_range("AVLSequence index is out of bounds");
+    }
+
+    auto node = root;
+    while (true){
+        push(node);
+        size_t left_size = sizeOf(node->left_child);
+        if (index < left_size){
+            node = node->left_child;
+        }
+        else if (index == left_size){
+            node->value = std::move(value);
+            return;
+        }
+        else{
+            index -= left_size + 1;
+            node = node->right_child;
+        }
+    }
+}
+
+template<typename T>
+void AVLSequence<T>::insert(size_t index, T value) {
+    checkRange(index, index);
+    auto node = createNode(std::move(value));
+    auto nodes = split(root, index);
+    root = mergeWithRootAndBalance(nodes.first, nodes.second, node);
+}
+
+template<typename T>
+void AVLSequence<T>::erase(size_t first, size_t last) {
+    auto middle = cut(first, last);
+    if (middle){
+        pool->destroyLater(middle);
+    }
+}
+
+template<typename T>
+AVLSequence<T> AVLSequence<T>::splitAt(size_t index) {
+    checkRange(index, size());
+    auto nodes = split(root, index);
+    root = nodes.first;
+    return AVLSequence(nodes.second, pool);
+}
+
+template<typename T>
+void AVLSequence<T>::append(AVLSequence &&other) {
+    if (this == &other){
+        return;
+    }
+    root = merge(root, takeNodes(other));
+}
+
+template<typename T>
+void AVLSequence<T>::reverse(size_t first, size_t last) {
+    tagRange(first, last, [](Node &middle){ middle.reversed = !middle.reversed; });
+}
+
+template<typename T>
+void AVLSequence<T>::add(size_t first, size_t last, const T &delta) {
+    static_assert(std::is_arithmetic<T>::value, "range addition needs arithmetic values");
+    tagRange(first, last, [&delta](Node &middle){ middle.addPending(delta); });
+}
+
+template<typename T>
+vector<T> AVLSequence<T>::toArray() const {
+    vector<T> array;
+    array.reserve(size());
+    collect(root, false, PendingAdd<T>(), array);
+    return array;
+}
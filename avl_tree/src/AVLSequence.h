@@ -0,0 +1,172 @@
+#pragma once
+
+#include <vector>
+#include <initializer_list>
+#include <memory>
+#include <utility>
+#include <type_traits>
+#include <stdexcept>
+
+#include "NodePool.h"
+
+namespace avl{
+    //pending range addition of a subtree, kept only for arithmetic values
+    template<class T, bool = std::is_arithmetic<T>::value>
+    struct PendingAdd{
+        T added = T();
+
+        bool hasPendingAdd() const { return added != T(); }
+
+        void addPending(const T &delta) { added += delta; }
+
+        void collect(const PendingAdd &other) { added += other.added; }
+
+        void applyTo(T &value) const { value += added; }
+
+        void resetPending() { added = T(); }
+    };
+
+    template<class T>
+    struct PendingAdd<T, false>{
+        bool hasPendingAdd() const { return false; }
+
+        void collect(const PendingAdd &) {}
+
+        void applyTo(T &) const {}
+
+        void resetPending() {}
+    };
+
+    //sequence on an AVL tree keyed implicitly by position (a rope): insertion, erasure,
+    //split and concatenation at any index in O(log n). reversal and, for arithmetic values,
+    //addition over index ranges are kept as lazy tags and pushed down when a node is visited.
+    //index ranges are half-open, [first, last)
+    template<class T>
+    class AVLSequence {
+    private:
+        struct Node : PendingAdd<T>{
+            T value;
+
+            Node *left_child = nullptr;
+
+            Node *right_child = nullptr;
+
+            unsigned int subtree_height = 1;
+
+            size_t subtree_size = 1;
+
+            //the subtree is to be mirrored
+            bool reversed = false;
+
+            explicit Node(const T &value) : value(value) {}
+
+            explicit Node(T &&value) : value(std::move(value)) {}
+
+            void update();
+        };
+
+        using Pool = NodePool<Node>;
+
+        //split sequences share the pool of the source, which is not synchronized
+        std::shared_ptr<Pool> pool;
+
+        Node *root = nullptr;
+
+        AVLSequence(Node *root, const std::shared_ptr<Pool> &pool);
+
+        static size_t sizeOf(const Node *node) { return node ? node->subtree_size : 0; }
+
+        static unsigned int heightOf(const Node *node) { return node ? node->subtree_height : 0; }
+
+        static void push(Node *node);
+
+        static Node *leftRotate(Node *k2);
+
+        static Node *rightRotate(Node *k2);
+
+        static Node *recoverBalance(Node *subtree_root);
+
+        static Node *mergeWithRootAndBalance(Node *left, Node *right, Node *subtree_root);
+
+        static Node *merge(Node *left, Node *right);
+
+        static std::pair<Node *, Node *> extractFirst(Node *subtree_root);
+
+        static std::pair<Node *, Node *> split(Node *subtree_root, size_t count);
+
+        static Node *copySubtree(const Node *subtree_root, Pool &pool);
+
+        static void collect(const Node *subtree_root, bool reversed, PendingAdd<T> pending, std::vector<T> &array);
+
+        template<class Iterator>
+        Node *buildBalanced(Iterator first, size_t count);
+
+        template<class... Args>
+        Node *createNode(Args&&... args);
+
+        Node *takeNodes(AVLSequence &other);
+
+        void checkRange(size_t first, size_t last) const;
+
+        //cuts [first, last) out of the sequence, the outer parts are joined
+        Node *cut(size_t first, size_t last);
+
+        //splits [first, last) off, calls tag on its root and joins the three parts back, O(log n)
+        template<class F>
+        void tagRange(size_t first, size_t last, F tag);
+
+    public:
+        AVLSequence() = default;
+
+        explicit AVLSequence(const std::vector<T> &elements);
+
+        AVLSequence(const std::initializer_list<T> &il);
+
+        AVLSequence(const AVLSequence &other);
+
+        AVLSequence(AVLSequence &&other) noexcept;
+
+        AVLSequence &operator=(const AVLSequence &other);
+
+        AVLSequence &operator=(AVLSequence &&other) noexcept;
+
+        ~AVLSequence();
+
+        void clear();
+
+        size_t size() const { return sizeOf(root); }
+
+        bool empty() const { return root == nullptr; }
+
+        size_t height() const { return heightOf(root); }
+
+        //value at index with the pending tags applied, throws std::out_of_range
+        T at(size_t index) const;
+
+        void set(size_t index, T value);
+
+        void insert(size_t index, T value);
+
+        void pushBack(T value) { insert(size(), std::move(value)); }
+
+        void pushFront(T value) { insert(0, std::move(value)); }
+
+        void erase(size_t index) { erase(index, index + 1); }
+
+        void erase(size_t first, size_t last);
+
+        //moves the values from index on into the returned sequence, which shares the pool of this one:
+        //they are not changed from different threads at once, unless one of them is copied first
+        AVLSequence splitAt(size_t index);
+
+        //concatenation, other is left empty
+        void append(AVLSequence &&other);
+
+        void reverse(size_t first, size_t last);
+
+        //adds delta to every value in [first, last), only for arithmetic values
+        void add(size_t first, size_t last, const T &delta);
+
+        std::vector<T> toArray() const;
+    };
+}
@@ -3,50 +3,60 @@
 using namespace std;
 using namespace avl;
 
-template<typename T, typename TCompare>
-typename AVLTree<T, TCompare>::Node &AVLTree<T, TCompare>::Node::operator =(const typename AVLTree<T, TCompare>::Node &other){
-    if (this != &other) {
-        this->left_child = nullptr;
-        this->right_child = nullptr; //instead of deletion
-        auto *tmp = new typename AVLTree<T, TCompare>::Node(other);
-        std::swap(*tmp, *this);
-    }
-    return *this;
-}
-
-template<typename T, typename TCompare>
-void AVLTree<T, TCompare>::Node::updateHeight()
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+void AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node::updateHeight()
 {
     this->subtree_height = 1 + std::max(left_child ? left_child->subtree_height : 0,
                                         right_child ? right_child->subtree_height : 0);
 }
 
-template<typename T, typename TCompare>
-void AVLTree<T, TCompare>::Node::updateSize() {
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+void AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node::updateSize() {
     this->subtree_size = 1
                          + (left_child ? left_child->subtree_size : 0)
                          + (right_child ? right_child->subtree_size: 0);
+    //the aggregate changes exactly when the size may, so it is kept up to date here
+    this->updateAggregate(value, left_child, right_child);
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node::Node(const T &value, Node *left_child, Node *right_child)
+        :left_child(left_child)
+        ,right_child(right_child)
+        ,value(value)
+{
+    updateHeight();
+    updateSize();
 }
 
-template<typename T, typename TCompare>
-AVLTree<T, TCompare>::Node::Node(const T &value, const sNode &left_child, const sNode &right_child)
-        :value(value)
-        ,left_child(left_child)
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node::Node(T &&value, Node *left_child, Node *right_child)
+        :left_child(left_child)
         ,right_child(right_child)
+        ,value(std::move(value))
 {
     updateHeight();
     updateSize();
 }
 
-template<typename T, typename TCompare>
-typename AVLTree<T, TCompare>::Node::sNode AVLTree<T, TCompare>::Node::deepCopy() const{
-    auto copy = std::make_shared<AVLTree<T, TCompare>::Node>(this->value);
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+template<class... Args>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node::Node(std::piecewise_construct_t, Args&&... args)
+        :left_child(nullptr)
+        ,right_child(nullptr)
+        ,value(std::forward<Args>(args)...){
+    updateSize();
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node::deepCopy(Pool &pool) const{
+    auto copy = pool.create(this->value);
     if (right_child){
-        copy->right_child = right_child->deepCopy();
+        copy->right_child = right_child->deepCopy(pool);
     }
 
     if (left_child){
-        copy->left_child = left_child->deepCopy();
+        copy->left_child = left_child->deepCopy(pool);
     }
 
     copy->updateSize();
@@ -54,31 +64,15 @@ typename AVLTree<T, TCompare>::Node::sNode AVLTree<T, TCompare>::Node::deepCopy(
     return copy;
 }
 
-template<typename T, typename TCompare>
-AVLTree<T, TCompare>::Node::Node(const Node &other)
-        :value(other.value)
-{
-    if (other.left_child){
-        left_child = std::make_shared<AVLTree<T, TCompare>::Node>(AVLTree<T, TCompare>::Node(*other.left_child));
-    }
-
-    if (other.right_child){
-        right_child = std::make_shared<AVLTree<T, TCompare>::Node>(AVLTree<T, TCompare>::Node(*other.right_child));
-    }
-
-    updateSize();
-    updateHeight();
-}
-
-template<typename T, typename TCompare>
-int AVLTree<T, TCompare>::Node::heightDiff() const {
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+int AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node::heightDiff() const {
     int left_height = left_child? left_child->getHeight() : 0;
     int right_height = right_child ? right_child->getHeight() : 0;
     return left_height - right_height;
 }
 
-template<typename T, typename TCompare>
-void AVLTree<T, TCompare>::Node::print(ostream &os, uint indent) const{
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+void AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node::print(ostream &os, uint indent) const{
     auto child = this->right_child;
     if (child){
         child->print(os, indent + 3);
@@ -87,7 +81,7 @@ void AVLTree<T, TCompare>::Node::print(ostream &os, uint indent) const{
     for (uint i = 0; i < indent; ++i){
         os << " ";
     }
-    os << this->value << "(s" << this->subtree_size << ", h" << this->subtree_height << ')' << '\n';
+    os << this->value << "(s" << this->subtree_size << ", h" << unsigned(this->subtree_height) << ')' << '\n';
 
     child = this->left_child;
     if (child){
@@ -95,85 +89,619 @@ void AVLTree<T, TCompare>::Node::print(ostream &os, uint indent) const{
     }
 }
 
-template <typename T, typename TCompare>
-std::ostream &operator<<(ostream &os, const typename AVLTree<T, TCompare>::Node &node) {
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+std::ostream &operator<<(ostream &os, const typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node &node) {
     node.print(os);
     return os;
 }
 
-template<typename T, typename TCompare>
-typename AVLTree<T, TCompare>::sNode AVLTree<T, TCompare>::insert(sNode &subtree_root, const T &value) {
-    if (!subtree_root){
-        return make_shared<Node>(value);
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+template<class... Args>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *AVLTree<T, TCompare, TAggregate, TLayout, TStats>::createNode(Args&&... args) {
+    if (!pool){
+        pool = make_shared<Pool>();
     }
+    auto node = pool->create(std::forward<Args>(args)...);
+    node->version = version;
+    return node;
+}
 
-    auto cur_value = subtree_root->getValue();
-    if (cmp(value, cur_value)){
-        subtree_root->left_child = insert(subtree_root->left_child, value);
+//returns a node that may be changed in place, copying it if a snapshot can reach it
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *AVLTree<T, TCompare, TAggregate, TLayout, TStats>::own(Node *node) {
+    if (!isShared(node)){
+        return node;
     }
-    else if (cmp(cur_value, value)){
-        subtree_root->right_child = insert(subtree_root->right_child, value);
+
+    auto copy = pool->create(*node);
+    copy->version = version;
+    retired.push_back(Retired{version, node, false});
+    return copy;
+}
+
+//frees a node removed from the tree, or keeps it for the snapshots
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+void AVLTree<T, TCompare, TAggregate, TLayout, TStats>::release(Node *node) {
+    if (isShared(node)){
+        retired.push_back(Retired{version, node, false});
     }
     else{
-        return subtree_root;
+        pool->destroy(node);
     }
-
-    subtree_root = recoverBalance(subtree_root);
-    return subtree_root;
 }
 
-template<typename T, typename TCompare>
-typename AVLTree<T, TCompare>::sNode AVLTree<T, TCompare>::findNode(const T &value, sNode subtree_root) {
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+void AVLTree<T, TCompare, TAggregate, TLayout, TStats>::releaseSubtree(Node *subtree_root) {
     if (!subtree_root){
-        return subtree_root;
+        return;
+    }
+
+    if (!frozen_version){
+        pool->destroyLater(subtree_root);
+        return;
     }
 
-    auto cur_value = subtree_root->getValue();
-    if (cmp(value, cur_value)){
-        return findNode(value, subtree_root->left_child);
+    if (isShared(subtree_root)){ //children of shared nodes are shared as well
+        retired.push_back(Retired{version, subtree_root, true});
+        return;
     }
-    else if (cmp(cur_value, value)){
-        return findNode(value, subtree_root->right_child);
+
+    releaseSubtree(subtree_root->left_child);
+    releaseSubtree(subtree_root->right_child);
+    pool->destroy(subtree_root);
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+void AVLTree<T, TCompare, TAggregate, TLayout, TStats>::freeRetired(const Retired &entry) {
+    if (entry.whole_subtree){
+        destroySubtree(entry.node);
     }
     else{
-        return subtree_root;
+        pool->destroy(entry.node);
+    }
+}
+
+//frees the retired nodes no live snapshot can reach
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+void AVLTree<T, TCompare, TAggregate, TLayout, TStats>::collectRetired() {
+    bool has_snapshots;
+    uint64_t oldest = 0;
+    {
+        std::lock_guard<std::mutex> lock(registry->mutex);
+        has_snapshots = !registry->versions.empty();
+        if (has_snapshots){
+            oldest = *registry->versions.begin();
+        }
+    }
+
+    while (!retired.empty() && (!has_snapshots || retired.front().version < oldest)){
+        freeRetired(retired.front());
+        retired.pop_front();
+    }
+
+    if (!has_snapshots){
+        frozen_version = 0;
+    }
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::SnapshotRegistry::~SnapshotRegistry() {
+    if (std::is_trivially_destructible<T>::value){
+        return;
+    }
+
+    for (auto &entry : orphans){
+        std::stack<Node *> nodes;
+        nodes.push(entry.node);
+        while (!nodes.empty()){
+            auto node = nodes.top();
+            nodes.pop();
+            if (entry.whole_subtree && node->left_child){
+                nodes.push(node->left_child);
+            }
+            if (entry.whole_subtree && node->right_child){
+                nodes.push(node->right_child);
+            }
+            node->~Node();
+        }
+    }
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+const typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *AVLTree<T, TCompare, TAggregate, TLayout, TStats>::selectNode(const Node *subtree_root, size_t k) {
+    if (!subtree_root || k >= subtree_root->getSize()){
+        throw std::out_of_range("AVLTree: select index is out of range");
+    }
+
+    while (true){
+        size_t left_size = subtree_root->left_child ? subtree_root->left_child->getSize() : 0;
+        if (k < left_size){
+            subtree_root = subtree_root->left_child;
+        }
+        else if (k > left_size){
+            k -= left_size + 1;
+            subtree_root = subtree_root->right_child;
+        }
+        else{
+            return subtree_root;
+        }
     }
 }
 
-template<typename T, typename TCompare>
-typename AVLTree<T, TCompare>::sNode AVLTree<T, TCompare>::deleteIfExists(const T &value, sNode &subtree_root) {
+//number of values less than value (or not greater, if or_equal is set)
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+size_t AVLTree<T, TCompare, TAggregate, TLayout, TStats>::countLess(const Node *subtree_root, const T &value, const TCompare &cmp, bool or_equal) {
+    size_t count = 0;
+    while (subtree_root){
+        bool go_left = or_equal ? cmp(value, subtree_root->value) : !cmp(subtree_root->value, value);
+        if (go_left){
+            subtree_root = subtree_root->left_child;
+        }
+        else{
+            count += 1 + (subtree_root->left_child ? subtree_root->left_child->getSize() : 0);
+            subtree_root = subtree_root->right_child;
+        }
+    }
+    return count;
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+size_t AVLTree<T, TCompare, TAggregate, TLayout, TStats>::countInRange(const Node *subtree_root, const T &lo, const T &hi, const TCompare &cmp) {
+    if (cmp(hi, lo)){
+        return 0;
+    }
+    return countLess(subtree_root, hi, cmp, true) - countLess(subtree_root, lo, cmp, false);
+}
+
+//first node not less than value (or greater than value, if strictly_greater is set)
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+const typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::boundNode(const Node *subtree_root, const T &value, const TCompare &cmp, bool strictly_greater) {
+    const Node *bound = nullptr;
+    while (subtree_root){
+        bool go_left = strictly_greater ? cmp(value, subtree_root->value) : !cmp(subtree_root->value, value);
+        if (go_left){
+            bound = subtree_root;
+            subtree_root = subtree_root->left_child;
+        }
+        else{
+            subtree_root = subtree_root->right_child;
+        }
+    }
+    return bound;
+}
+
+//visits in order the values v with above(v) and below(v), both predicates are monotone
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+template<class Above, class Below, class F>
+void AVLTree<T, TCompare, TAggregate, TLayout, TStats>::visitWhere(const Node *subtree_root, const Above &above, const Below &below, F &f) {
     if (!subtree_root){
-        return nullptr;
+        return;
     }
 
-    auto cur_value = subtree_root->getValue();
-    if(cmp(value, cur_value)){
-        subtree_root->left_child = deleteIfExists(value, subtree_root->left_child);
+    bool above_lo = above(subtree_root->value);
+    bool below_hi = below(subtree_root->value);
+    if (above_lo){
+        visitWhere(subtree_root->left_child, above, below, f);
     }
-    else if(cmp(cur_value, value)){
-        subtree_root->right_child = deleteIfExists(value, subtree_root->right_child);
+    if (above_lo && below_hi){
+        f(subtree_root->value);
     }
-    else{
-        if (!subtree_root->left_child){
+    if (below_hi){
+        visitWhere(subtree_root->right_child, above, below, f);
+    }
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+template<class F>
+void AVLTree<T, TCompare, TAggregate, TLayout, TStats>::visitRange(const Node *subtree_root, const T &lo, const T &hi, const TCompare &cmp, F &f) {
+    visitWhere(subtree_root, [&](const T &value){ return !cmp(value, lo); },
+               [&](const T &value){ return !cmp(hi, value); }, f);
+}
+
+//the paths to both ends part at the topmost value in range,
+//below it whole subtrees inside the range contribute their stored aggregates
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+template<class A, class Above, class Below>
+typename A::value_type
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::aggregateWhere(const Node *subtree_root, const Above &above, const Below &below) {
+    while (subtree_root){
+        if (!above(subtree_root->value)){
             subtree_root = subtree_root->right_child;
+        }
+        else if (!below(subtree_root->value)){
+            subtree_root = subtree_root->left_child;
+        }
+        else{
+            break;
+        }
+    }
+    if (!subtree_root){
+        return A::identity();
+    }
+
+    //values of the left subtree in range, collected from the largest ones
+    auto prefix = A::identity();
+    for (auto node = subtree_root->left_child; node;){
+        if (!above(node->value)){
+            node = node->right_child;
+        }
+        else{
+            prefix = A::combine(A::combine(A::lift(node->value), aggregateOf<A>(node->right_child)), prefix);
+            node = node->left_child;
+        }
+    }
+
+    //values of the right subtree in range, collected from the smallest ones
+    auto suffix = A::identity();
+    for (auto node = subtree_root->right_child; node;){
+        if (!below(node->value)){
+            node = node->left_child;
+        }
+        else{
+            suffix = A::combine(suffix, A::combine(aggregateOf<A>(node->left_child), A::lift(node->value)));
+            node = node->right_child;
+        }
+    }
+    return A::combine(A::combine(prefix, A::lift(subtree_root->value)), suffix);
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+template<class K, class A>
+typename A::value_type
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::aggregateRange(const Node *subtree_root, const K &lo, const K &hi, const TCompare &cmp) {
+    return aggregateWhere<A>(subtree_root, [&](const T &value){ return !cmp(value, lo); },
+                             [&](const T &value){ return !cmp(hi, value); });
+}
+
+//subtree_root holds exactly the values of this tree strictly between lo and hi, a missing bound is open
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+template<class A>
+void AVLTree<T, TCompare, TAggregate, TLayout, TStats>::diffBetween(const Node *subtree_root, const T *lo, const T *hi, const AVLTree &other,
+                                                   std::vector<T> &only_here, std::vector<T> &only_there) const {
+    auto above = [this, lo](const T &value){ return !lo || cmp(*lo, value); };
+    auto below = [this, hi](const T &value){ return !hi || cmp(value, *hi); };
+    if (!subtree_root){
+        auto collect = [&only_there](const T &value){ only_there.push_back(value); };
+        visitWhere(other.root, above, below, collect);
+        return;
+    }
+    if (subtree_root->aggregate == aggregateWhere<A>(other.root, above, below)){
+        return;
+    }
+
+    diffBetween<A>(subtree_root->left_child, lo, &subtree_root->value, other, only_here, only_there);
+    if (!findNode(other.root, subtree_root->value, cmp)){
+        only_here.push_back(subtree_root->value);
+    }
+    diffBetween<A>(subtree_root->right_child, &subtree_root->value, hi, other, only_here, only_there);
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+template<class A>
+std::pair<std::vector<T>, std::vector<T>> AVLTree<T, TCompare, TAggregate, TLayout, TStats>::diff(const AVLTree &other) const {
+    std::pair<std::vector<T>, std::vector<T>> result;
+    diffBetween<A>(root, nullptr, nullptr, other, result.first, result.second);
+    return result;
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Snapshot AVLTree<T, TCompare, TAggregate, TLayout, TStats>::snapshot() {
+    if (!registry){
+        registry = make_shared<SnapshotRegistry>();
+    }
+    uint64_t next = nextVersion();
+    if (next > std::numeric_limits<typename TLayout::version_type>::max()){
+        throw std::overflow_error("AVLTree: the node layout has no room for more snapshot versions");
+    }
+    frozen_version = version = next;
+    return Snapshot(root, pool, registry, frozen_version, cmp);
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Snapshot::Snapshot(Node *root, const std::shared_ptr<Pool> &pool,
+                                         const std::shared_ptr<SnapshotRegistry> &registry, uint64_t version, const TCompare &cmp)
+        :root(root)
+        ,pool(pool)
+        ,registry(registry)
+        ,version(version)
+        ,cmp(cmp){
+    std::lock_guard<std::mutex> lock(registry->mutex);
+    registry->versions.insert(version);
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Snapshot::Snapshot(const Snapshot &other)
+        :Snapshot(other.root, other.pool, other.registry, other.version, other.cmp){}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Snapshot &AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Snapshot::operator=(const Snapshot &other) {
+    if (this != &other){
+        Snapshot tmp(other);
+        std::swap(root, tmp.root);
+        std::swap(pool, tmp.pool);
+        std::swap(registry, tmp.registry);
+        std::swap(version, tmp.version);
+        std::swap(cmp, tmp.cmp);
+    }
+    return *this;
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Snapshot::~Snapshot() {
+    std::lock_guard<std::mutex> lock(registry->mutex);
+    registry->versions.erase(registry->versions.find(version));
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+std::vector<T> AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Snapshot::toArray() const {
+    vector<T> array;
+    array.reserve(size());
+    for (auto &value : *this){
+        array.push_back(value);
+    }
+    return array;
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+void AVLTree<T, TCompare, TAggregate, TLayout, TStats>::destroySubtree(Node *subtree_root) {
+    if (!subtree_root){
+        return;
+    }
+
+    destroySubtree(subtree_root->left_child);
+    destroySubtree(subtree_root->right_child);
+    pool->destroy(subtree_root);
+}
+
+//walks down from subtree_root without changing anything, the path ends above the node found
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+template<class K>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *AVLTree<T, TCompare, TAggregate, TLayout, TStats>::descend(Node *subtree_root, const K &value, SearchPath &path) const {
+    size_t comparisons = 0;
+    while (subtree_root){
+        bool go_left = cmp(value, subtree_root->value);
+        comparisons += go_left ? 1 : 2;
+        if (!go_left && !cmp(subtree_root->value, value)){
+            stats.countComparisons(comparisons);
+            stats.recordSearchDepth(path.length + 1);
             return subtree_root;
         }
+        path.nodes[path.length] = subtree_root;
+        path.went_left[path.length] = go_left;
+        ++path.length;
+        subtree_root = go_left ? subtree_root->left_child : subtree_root->right_child;
+    }
+    stats.countComparisons(comparisons);
+    stats.recordSearchDepth(path.length);
+    return nullptr;
+}
+
+//hangs child where the search stopped and restores balance up to the top of the path.
+//if position is given, it is set to the path from the new root to child
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *AVLTree<T, TCompare, TAggregate, TLayout, TStats>::ascend(const SearchPath &path, Node *child, AVLIterator *position) {
+    //the path is collected bottom-up
+    const Node *target = child;
+    if (position){
+        position->length = 0;
+        position->path[position->length++] = target;
+    }
 
-        sNode temp = subtree_root->left_child;
-        while(temp->right_child){
-            temp = temp->right_child;
+    for (size_t i = path.length; i-- > 0;){
+        auto parent = own(path.nodes[i]);
+        if (path.went_left[i]){
+            parent->left_child = child;
+        }
+        else{
+            parent->right_child = child;
+        }
+        child = recoverBalance(parent);
+        if (!position){
+            continue;
+        }
+
+        if (child == parent){
+            position->path[position->length++] = parent;
+        }
+        else{
+            //a rotation reshaped the top of the subtree, the part of the path inside it is found again
+            position->length = 0;
+            for (const Node *node = child; node != target;
+                 node = cmp(target->value, node->value) ? node->left_child : node->right_child){
+                position->path[position->length++] = node;
+            }
+            position->path[position->length++] = target;
+            std::reverse(position->path, position->path + position->length);
         }
-        std::swap(subtree_root->value, temp->value); //sizes and heights remain the same
-        subtree_root->left_child = deleteIfExists(value, subtree_root->left_child);
     }
 
-    subtree_root = recoverBalance(subtree_root);
+    if (position){
+        position->root = child;
+        std::reverse(position->path, position->path + position->length);
+    }
+    return child;
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+template<class K>
+const typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::findNode(const Node *subtree_root, const K &value, const TCompare &cmp, TStats *stats) {
+    size_t depth = 0;
+    size_t comparisons = 0;
+    while (subtree_root){
+        ++depth;
+        ++comparisons;
+        if (cmp(value, subtree_root->value)){
+            subtree_root = subtree_root->left_child;
+            continue;
+        }
+        ++comparisons;
+        if (cmp(subtree_root->value, value)){
+            subtree_root = subtree_root->right_child;
+        }
+        else{
+            break;
+        }
+    }
+    if (stats){
+        stats->countComparisons(comparisons);
+        stats->recordSearchDepth(depth);
+    }
     return subtree_root;
 }
 
-template<typename T, typename TCompare>
-typename AVLTree<T, TCompare>::sNode AVLTree<T, TCompare>::leftRotate(sNode k2) {
-    sNode k1 = k2->right_child;
+//search path of value that starts from the node of a root-to-node path instead of the root.
+//ancestors bound the values below them, and the bounds tighten downwards,
+//so only the violated bounds nearest to the start node and one more on each side are compared
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+template<class K>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *AVLTree<T, TCompare, TAggregate, TLayout, TStats>::descendNear(const AVLIterator &start, const K &value, SearchPath &path) const {
+    //the end iterator stands for the path to the largest value
+    size_t length = start.length;
+    for (size_t i = 0; i < length; ++i){
+        path.nodes[i] = const_cast<Node *>(start.path[i]);
+    }
+    if (!length){
+        for (auto node = root; node; node = node->right_child){
+            path.nodes[length++] = node;
+        }
+        if (!length){
+            return nullptr;
+        }
+    }
+    for (size_t i = 0; i + 1 < length; ++i){
+        path.went_left[i] = path.nodes[i]->left_child == path.nodes[i + 1];
+    }
+
+    size_t top = length - 1;
+    bool upper_holds = false;
+    bool lower_holds = false;
+    for (size_t i = top; i-- > 0 && !(upper_holds && lower_holds);){
+        bool &holds = path.went_left[i] ? upper_holds : lower_holds;
+        if (holds){
+            continue;
+        }
+        const T &bound = path.nodes[i]->value;
+        holds = path.went_left[i] ? cmp(value, bound) : cmp(bound, value);
+        if (!holds){
+            top = i;
+        }
+    }
+    path.length = top;
+    return descend(path.nodes[top], value, path);
+}
+
+//the finger is dropped when the tree was moved away from under it
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::AVLIterator &AVLTree<T, TCompare, TAggregate, TLayout, TStats>::fingerPath() {
+    if (!finger){
+        finger.reset(new AVLIterator(root, true));
+    }
+    else if (finger->root != root){
+        *finger = AVLIterator(root, true);
+    }
+    return *finger;
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+template<class V>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::AVLIterator
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::insertNear(const AVLIterator &start, V &&value, bool &inserted) {
+    SearchPath path;
+    auto found = descendNear(start, value, path);
+    beginUpdate();
+
+    AVLIterator position(root, true);
+    inserted = !found;
+    if (found){
+        std::copy(path.nodes, path.nodes + path.length, position.path);
+        position.path[path.length] = found;
+        position.length = path.length + 1;
+    }
+    else{
+        root = ascend(path, createNode(std::forward<V>(value)), &position);
+    }
+    return position;
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+template<class V>
+bool AVLTree<T, TCompare, TAggregate, TLayout, TStats>::insertAtFinger(V &&value) {
+    bool inserted;
+    auto position = insertNear(fingerPath(), std::forward<V>(value), inserted);
+    *finger = position;
+    return inserted;
+}
+
+//the finger moves to the last node visited, found or not
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+bool AVLTree<T, TCompare, TAggregate, TLayout, TStats>::containsNear(const T &value) {
+    auto &start = fingerPath();
+    SearchPath path;
+    auto found = descendNear(start, value, path);
+    if (found){
+        path.nodes[path.length++] = found;
+    }
+    std::copy(path.nodes, path.nodes + path.length, start.path);
+    start.length = path.length;
+    return found != nullptr;
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+template<class V>
+bool AVLTree<T, TCompare, TAggregate, TLayout, TStats>::insertValue(V &&value) {
+    beginUpdate();
+    SearchPath path;
+    if (descend(root, value, path)){
+        return false;
+    }
+    root = ascend(path, createNode(std::forward<V>(value)));
+    return true;
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+template<class... Args>
+bool AVLTree<T, TCompare, TAggregate, TLayout, TStats>::emplace(Args&&... args) {
+    beginUpdate();
+    auto node = createNode(std::piecewise_construct, std::forward<Args>(args)...);
+    SearchPath path;
+    if (descend(root, node->value, path)){
+        pool->destroy(node);
+        return false;
+    }
+    root = ascend(path, node);
+    return true;
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+template<class K>
+bool AVLTree<T, TCompare, TAggregate, TLayout, TStats>::eraseValue(const K &value) {
+    beginUpdate();
+    SearchPath path;
+    auto deleted = descend(root, value, path);
+    if (!deleted){
+        return false;
+    }
+
+    auto replacement = deleted->left_child;
+    if (deleted->right_child){
+        //the successor takes the place of the deleted node
+        auto nodes = extractMin(deleted->right_child);
+        replacement = nodes.second;
+        replacement->left_child = deleted->left_child;
+        replacement->right_child = nodes.first;
+        replacement = recoverBalance(replacement);
+    }
+    release(deleted);
+    root = ascend(path, replacement);
+    return true;
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *AVLTree<T, TCompare, TAggregate, TLayout, TStats>::leftRotate(Node *k2) {
+    k2 = own(k2);
+    Node *k1 = own(k2->right_child);
     k2->right_child = k1->left_child;
     k1->left_child = k2;
 
@@ -192,9 +720,10 @@ typename AVLTree<T, TCompare>::sNode AVLTree<T, TCompare>::leftRotate(sNode k2)
          Y    Z              X    Y
  */
 
-template<typename T, typename TCompare>
-typename AVLTree<T, TCompare>::sNode AVLTree<T, TCompare>::rightRotate(sNode k2) {
-    sNode k1 = k2->left_child;
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *AVLTree<T, TCompare, TAggregate, TLayout, TStats>::rightRotate(Node *k2) {
+    k2 = own(k2);
+    Node *k1 = own(k2->left_child);
     k2->left_child = k1->right_child;
     k1->right_child = k2;
 
@@ -213,8 +742,9 @@ typename AVLTree<T, TCompare>::sNode AVLTree<T, TCompare>::rightRotate(sNode k2)
     X   Y                    Y    Z
 */
 
-template<typename T, typename TCompare>
-typename AVLTree<T, TCompare>::sNode AVLTree<T, TCompare>::recoverBalance(sNode subtree_root) {
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *AVLTree<T, TCompare, TAggregate, TLayout, TStats>::recoverBalance(Node *subtree_root) {
+    subtree_root = own(subtree_root);
     int diff = subtree_root->heightDiff();
     if (diff >= -1 && diff <= 1){
         subtree_root->updateHeight();
@@ -223,65 +753,319 @@ typename AVLTree<T, TCompare>::sNode AVLTree<T, TCompare>::recoverBalance(sNode
     }
 
     if (diff == 2){ //left child exists
-        if (subtree_root->left_child->heightDiff() < 0){ //>0
+        bool is_double = subtree_root->left_child->heightDiff() < 0;
+        if (is_double){ //>0
             subtree_root->left_child = leftRotate(subtree_root->left_child);
         }
         subtree_root = rightRotate(subtree_root);
+        stats.countRotation(is_double);
     }
     else if (diff == - 2){ //right child exists
-        if (subtree_root->right_child->heightDiff() > 0){
+        bool is_double = subtree_root->right_child->heightDiff() > 0;
+        if (is_double){
             subtree_root->right_child = rightRotate(subtree_root->right_child);
         }
         subtree_root = leftRotate(subtree_root);
+        stats.countRotation(is_double);
     }
 
     return subtree_root;
 }
 
-template<typename T, typename TCompare>
-AVLTree<T, TCompare>::AVLTree(sNode root, const TCompare &cmp) //what's going on
-        :root(root)
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::AVLTree(const TCompare &cmp)
+        :root(nullptr)
         ,cmp(cmp){}
 
-template<typename T, typename TCompare>
-AVLTree<T, TCompare>::AVLTree(const vector<T> &elements, const TCompare &cmp)
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::AVLTree(Node *root, const std::shared_ptr<Pool> &pool, const TCompare &cmp)
+        :pool(pool)
+        ,root(root)
+        ,cmp(cmp){}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+bool AVLTree<T, TCompare, TAggregate, TLayout, TStats>::isSortedUnique(const vector<T> &elements) const {
+    for (size_t i = 1; i < elements.size(); ++i){
+        if (!cmp(elements[i - 1], elements[i])){
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+void AVLTree<T, TCompare, TAggregate, TLayout, TStats>::sortUnique(vector<T> &elements) const {
+    parallelSort(elements.begin(), elements.end(), cmp, parallelDepth());
+    auto last = std::unique(elements.begin(), elements.end(), [this](const T &lhs, const T &rhs){
+        return !cmp(lhs, rhs); //sorted, so equivalent elements are adjacent
+    });
+    elements.erase(last, elements.end());
+}
+
+//builds a perfectly balanced subtree from count sorted elements in O(count) into target.
+//the right subtrees of the top depth levels are built on their own threads into pools of their own,
+//which target adopts after the join
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+template<class Iterator>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *AVLTree<T, TCompare, TAggregate, TLayout, TStats>::buildBalanced(Iterator first, size_t count, Pool &target, unsigned depth) {
+    if (count == 0){
+        return nullptr;
+    }
+
+    size_t left_count = count / 2;
+    auto middle = first;
+    std::advance(middle, left_count);
+    Node *left, *right;
+    if (depth == 0 || count < parallel_grain){
+        left = buildBalanced(first, left_count, target, 0);
+        right = buildBalanced(std::next(middle), count - left_count - 1, target, 0);
+    }
+    else{
+        Pool right_pool;
+        forkJoin(true,
+                 [&](){ right = buildBalanced(std::next(middle), count - left_count - 1, right_pool, depth - 1); },
+                 [&](){ left = buildBalanced(first, left_count, target, depth - 1); });
+        target.adopt(std::move(right_pool));
+    }
+
+    auto node = target.create(*middle, left, right);
+    node->version = version;
+    return node;
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+template<class Iterator>
+void AVLTree<T, TCompare, TAggregate, TLayout, TStats>::assignSortedUnique(Iterator first, size_t count) {
+    clear();
+    if (count > 0){
+        pool = make_shared<Pool>();
+        root = buildBalanced(first, count, *pool, parallelDepth());
+    }
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::AVLTree(const vector<T> &elements, const TCompare &cmp)
 :root(nullptr)
 ,cmp(cmp){
-    for (auto el : elements){
-        insert(el);
+    if (isSortedUnique(elements)){
+        assignSortedUnique(elements.begin(), elements.size());
+        return;
+    }
+
+    vector<T> sorted(elements);
+    sortUnique(sorted);
+    assignSortedUnique(std::make_move_iterator(sorted.begin()), sorted.size());
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::AVLTree(vector<T> &&elements, const TCompare &cmp)
+:root(nullptr)
+,cmp(cmp){
+    if (!isSortedUnique(elements)){
+        sortUnique(elements);
+    }
+    assignSortedUnique(std::make_move_iterator(elements.begin()), elements.size());
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::AVLTree(SortedUniqueTag, const vector<T> &elements, const TCompare &cmp)
+:root(nullptr)
+,cmp(cmp){
+    assignSortedUnique(elements.begin(), elements.size());
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+void AVLTree<T, TCompare, TAggregate, TLayout, TStats>::save(std::ostream &os) const {
+    static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable values can be saved");
+    FileHeader header{FileHeader::expected_magic, FileHeader::current_format, sizeof(T),
+                      static_cast<uint32_t>(height()), size(), 0};
+    os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    //values are gathered into blocks to keep the number of writes small
+    const size_t block_size = 4096;
+    vector<char> block(block_size * sizeof(T));
+    size_t filled = 0;
+    for (auto &value : *this){
+        std::memcpy(block.data() + filled * sizeof(T), &value, sizeof(T));
+        if (++filled == block_size){
+            os.write(block.data(), filled * sizeof(T));
+            filled = 0;
+        }
     }
+    os.write(block.data(), filled * sizeof(T));
+    if (!os){
+        throw std::runtime_error("cannot write AVLTree");
+    }
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats> AVLTree<T, TCompare, TAggregate, TLayout, TStats>::load(std::istream &is, const TCompare &cmp) {
+    static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable values can be loaded");
+    FileHeader header;
+    if (!is.read(reinterpret_cast<char *>(&header), sizeof(header))){
+        throw std::runtime_error("truncated AVLTree file");
+    }
+    checkHeader(header, sizeof(T));
+
+    //the buffer grows with what was actually read, so a lying header cannot force a huge allocation
+    const size_t block_bytes = size_t(1) << 20;
+    size_t total_bytes = size_t(header.size) * sizeof(T);
+    vector<char> values;
+    while (values.size() < total_bytes){
+        size_t filled = values.size();
+        values.resize(filled + std::min(block_bytes, total_bytes - filled));
+        if (!is.read(values.data() + filled, values.size() - filled)){
+            throw std::runtime_error("truncated AVLTree file");
+        }
+    }
+    return fromStoredValues(reinterpret_cast<const T *>(values.data()), header.size, cmp);
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats> AVLTree<T, TCompare, TAggregate, TLayout, TStats>::loadMapped(const std::string &path, const TCompare &cmp) {
+    static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable values can be loaded");
+    static_assert(alignof(T) <= alignof(FileHeader), "values behind the header would be misaligned");
+    MappedFile file(path);
+    if (file.size() < sizeof(FileHeader)){
+        throw std::runtime_error("truncated AVLTree file");
+    }
+    FileHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    checkHeader(header, sizeof(T));
+
+    size_t payload = file.size() - sizeof(FileHeader);
+    if (payload % sizeof(T) != 0 || payload / sizeof(T) != header.size){
+        throw std::runtime_error("AVLTree file size does not match its header");
+    }
+    return fromStoredValues(reinterpret_cast<const T *>(file.data() + sizeof(FileHeader)), header.size, cmp);
 }
 
-template<typename T, typename TCompare>
-std::vector<T> AVLTree<T, TCompare>::toArray() const{
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats> AVLTree<T, TCompare, TAggregate, TLayout, TStats>::fromStoredValues(const T *values, size_t count, const TCompare &cmp) {
+    auto unordered = std::adjacent_find(values, values + count, [&cmp](const T &first, const T &second){
+        return !cmp(first, second);
+    });
+    if (unordered != values + count){
+        throw std::runtime_error("AVLTree file is not sorted by the comparator");
+    }
+
+    AVLTree tree(cmp);
+    tree.assignSortedUnique(values, count);
+    return tree;
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+std::vector<T> AVLTree<T, TCompare, TAggregate, TLayout, TStats>::toArray() const{
     vector<T> array;
-    auto it = AVLIterator(*this); //copying is occuring
-    while (it.currentNode() != nullptr){
-        array.push_back(*it);
-        ++it;
+    array.reserve(size());
+    for (auto &value : *this){
+        array.push_back(value);
     }
     return array;
 }
 
-template<typename T, typename TCompare>
-AVLTree<T, TCompare> &AVLTree<T, TCompare>::operator=(const AVLTree &other) {
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats> &AVLTree<T, TCompare, TAggregate, TLayout, TStats>::operator=(const AVLTree &other) {
     if (this != &other){
-        AVLTree<T, TCompare>tmp(other);
+        AVLTree<T, TCompare, TAggregate, TLayout, TStats>tmp(other);
         std::swap(*this, tmp);
     }
     return *this;
 }
 
-template<class T, class TCompare>
-AVLTree<T, TCompare>::AVLTree(const AVLTree &other){
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats> &AVLTree<T, TCompare, TAggregate, TLayout, TStats>::operator=(AVLTree &&other) noexcept {
+    if (this != &other){
+        clear();
+        pool = std::move(other.pool);
+        root = other.root;
+        cmp = std::move(other.cmp);
+        registry = std::move(other.registry);
+        frozen_version = other.frozen_version;
+        version = other.version;
+        retired = std::move(other.retired);
+        other.root = nullptr;
+        other.frozen_version = 0;
+    }
+    return *this;
+}
+
+template<class T, class TCompare, class TAggregate, class TLayout, class TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::AVLTree(const AVLTree &other)
+        :root(nullptr)
+        ,cmp(other.cmp){
     if (other.root){
-        root = make_shared<Node>(Node(*other.root));
+        pool = make_shared<Pool>();
+        root = other.root->deepCopy(*pool);
+    }
+}
+
+template<class T, class TCompare, class TAggregate, class TLayout, class TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::AVLTree(AVLTree &&other) noexcept
+        :pool(std::move(other.pool))
+        ,root(other.root)
+        ,cmp(std::move(other.cmp))
+        ,registry(std::move(other.registry))
+        ,frozen_version(other.frozen_version)
+        ,version(other.version)
+        ,retired(std::move(other.retired)){
+    other.root = nullptr;
+    other.frozen_version = 0;
+}
+
+template<class T, class TCompare, class TAggregate, class TLayout, class TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::~AVLTree(){
+    clear();
+}
+
+template<class T, class TCompare, class TAggregate, class TLayout, class TStats>
+void AVLTree<T, TCompare, TAggregate, TLayout, TStats>::clear(){
+    beginUpdate();
+    if (frozen_version){ //snapshots are alive, they take over the nodes
+        if (root){
+            retired.push_back(Retired{version, root, true});
+        }
+        {
+            std::lock_guard<std::mutex> lock(registry->mutex);
+            registry->orphans.insert(registry->orphans.end(), retired.begin(), retired.end());
+            registry->orphan_pool = pool;
+        }
+        retired.clear();
+        registry.reset();
+        frozen_version = 0;
+        pool.reset();
+        root = nullptr;
+        return;
+    }
+
+    if (pool.use_count() > 1){ //nodes of other trees live in the same pool
+        pool->destroyLater(root);
+    }
+    else if (!std::is_trivially_destructible<T>::value){
+        //values need their destructors, slabs are still released at once
+        std::stack<Node *> nodes;
+        if (root){
+            nodes.push(root);
+        }
+        while (!nodes.empty()){
+            auto node = nodes.top();
+            nodes.pop();
+            if (node->left_child){
+                nodes.push(node->left_child);
+            }
+            if (node->right_child){
+                nodes.push(node->right_child);
+            }
+            node->~Node();
+        }
     }
+    pool.reset();
+    root = nullptr;
 }
 
-template<typename T, typename TCompare>
-typename AVLTree<T, TCompare>::sNode
-AVLTree<T, TCompare>::mergeWithRootAndBalance(AVLTree::sNode  left, AVLTree::sNode  right, AVLTree::sNode  subtree_root) {
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::mergeWithRootAndBalance(Node *left, Node *right, Node *subtree_root, size_t depth) {
     if (!subtree_root){
         return nullptr;
     }
@@ -290,6 +1074,8 @@ AVLTree<T, TCompare>::mergeWithRootAndBalance(AVLTree::sNode  left, AVLTree::sNo
             - (right? right->getHeight() : 0);
 
     if (heightDiff <= 1 && heightDiff >= -1){
+        stats.recordMergeDepth(depth);
+        subtree_root = own(subtree_root);
         subtree_root->left_child = left; //constructor if pass by ref
         subtree_root->right_child = right;
         subtree_root->updateHeight();
@@ -297,27 +1083,30 @@ AVLTree<T, TCompare>::mergeWithRootAndBalance(AVLTree::sNode  left, AVLTree::sNo
         return subtree_root;
     }
     if (heightDiff > 1){
-        auto temp_root = mergeWithRootAndBalance(left->right_child, right, subtree_root);
+        auto temp_root = mergeWithRootAndBalance(left->right_child, right, subtree_root, depth + 1);
+        left = own(left);
         left->right_child = temp_root;
         left = recoverBalance(left); //inside could be replaced
         return left;
     }
 
-    auto temp_root = mergeWithRootAndBalance(left, right->left_child, subtree_root);
+    auto temp_root = mergeWithRootAndBalance(left, right->left_child, subtree_root, depth + 1);
+    right = own(right);
     right->left_child = temp_root;
     right = recoverBalance(right);
     return right;
 }
 
-template<typename T, typename TCompare>
-pair<typename AVLTree<T, TCompare>::sNode  , typename AVLTree<T, TCompare>::sNode  >
-AVLTree<T, TCompare>::split(AVLTree::sNode  subtree_root, const T &value, bool left_is_strictly_Less) {
-    std::pair<sNode  , sNode  > result(nullptr, nullptr);
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+template<class K>
+pair<typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *, typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::split(Node *subtree_root, const K &value, bool left_is_strictly_Less) {
+    std::pair<Node *, Node *> result(nullptr, nullptr);
     if (!subtree_root){
         return result;
     }
     //go left
-    if (value < subtree_root->getValue() || value == subtree_root->getValue() && left_is_strictly_Less){
+    if (cmp(value, subtree_root->getValue()) || !cmp(subtree_root->getValue(), value) && left_is_strictly_Less){
         auto nodes = split(subtree_root->left_child, value, left_is_strictly_Less);
         auto new_right = mergeWithRootAndBalance(nodes.second, subtree_root->right_child, subtree_root);
         return std::make_pair(nodes.first, new_right);
@@ -329,167 +1118,562 @@ AVLTree<T, TCompare>::split(AVLTree::sNode  subtree_root, const T &value, bool l
     }
 }
 
-template<typename T, typename TCompare>
-void AVLTree<T, TCompare>::print(ostream &os) const {
-    os << "tree:\n";
-    if (root){
-        root->print(os);
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats> AVLTree<T, TCompare, TAggregate, TLayout, TStats>::sibling(Node *subtree_root) const {
+    AVLTree<T, TCompare, TAggregate, TLayout, TStats> tree(subtree_root, pool, cmp);
+    tree.registry = registry;
+    tree.frozen_version = frozen_version;
+    tree.version = version;
+    return tree;
+}
+
+//detaches the values in [lo, hi] and returns their root
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+template<class K>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *AVLTree<T, TCompare, TAggregate, TLayout, TStats>::cutRange(const K &lo, const K &hi) {
+    beginUpdate();
+    if (cmp(hi, lo)){
+        return nullptr;
     }
-    else{
-        os << "tree is empty";
+
+    auto less = split(root, lo, true);
+    auto rest = split(less.second, hi, false);
+    root = mergeAndBalance(less.first, rest.second);
+    return rest.first;
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+void AVLTree<T, TCompare, TAggregate, TLayout, TStats>::eraseRange(const T &lo, const T &hi) {
+    releaseSubtree(cutRange(lo, hi));
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats> AVLTree<T, TCompare, TAggregate, TLayout, TStats>::extractRange(const T &lo, const T &hi) {
+    return sibling(cutRange(lo, hi));
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+void AVLTree<T, TCompare, TAggregate, TLayout, TStats>::destroy(Garbage &garbage) {
+    for (auto subtree_root : garbage){
+        releaseSubtree(subtree_root);
     }
+    garbage.clear();
 }
 
-template<typename T, typename TCompare>
-std::pair<AVLTree<T, TCompare>, AVLTree<T, TCompare>> AVLTree<T, TCompare>::split(AVLTree &tree, const T &value, bool left_is_strictly_Less) {
-    auto nodes = split(tree.root, value, left_is_strictly_Less);
-    return std::make_pair(AVLTree<T, TCompare>(nodes.first), AVLTree<T, TCompare>(nodes.second));
+//moves the nodes of other into this tree's pool and returns their root
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *AVLTree<T, TCompare, TAggregate, TLayout, TStats>::takeNodes(AVLTree &other) {
+    other.beginUpdate();
+    auto other_root = other.root;
+    if (!other_root){
+        return nullptr;
+    }
+
+    if (!pool){
+        pool = make_shared<Pool>();
+    }
+
+    if (other.pool == pool){ //trees split from the same tree, other's snapshots are ours too
+        if (other.frozen_version > frozen_version){
+            registry = other.registry;
+            frozen_version = other.frozen_version;
+        }
+        version = std::max(version, other.version);
+        retired.insert(retired.end(), other.retired.begin(), other.retired.end());
+        other.retired.clear();
+        other.root = nullptr;
+        return other_root;
+    }
+
+    if (other.pool.use_count() == 1){ //no other tree lives in other's slabs
+        pool->adopt(std::move(*other.pool));
+        other.pool.reset();
+        other.root = nullptr;
+        return other_root;
+    }
+
+    auto copy = other_root->deepCopy(*pool);
+    other.clear();
+    return copy;
 }
 
+//splits into nodes less than value, the node equal to value (detached) and nodes greater than value
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+std::tuple<typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *, typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *, typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::splitAround(Node *subtree_root, const T &value) {
+    if (!subtree_root){
+        return std::make_tuple(nullptr, nullptr, nullptr);
+    }
 
-template<typename T, typename TCompare>
-AVLTree<T, TCompare>::AVLTree(const initializer_list<T> &il, const TCompare &cmp)
-:root(sNode(nullptr))
-,cmp(cmp){
-    for (auto el: il){
-        insert(el);
+    Node *left, *equal, *right;
+    if (cmp(value, subtree_root->value)){
+        std::tie(left, equal, right) = splitAround(subtree_root->left_child, value);
+        right = mergeWithRootAndBalance(right, subtree_root->right_child, subtree_root);
     }
+    else if (cmp(subtree_root->value, value)){
+        std::tie(left, equal, right) = splitAround(subtree_root->right_child, value);
+        left = mergeWithRootAndBalance(subtree_root->left_child, left, subtree_root);
+    }
+    else{
+        left = subtree_root->left_child;
+        right = subtree_root->right_child;
+        equal = own(subtree_root);
+        equal->left_child = equal->right_child = nullptr;
+    }
+    return std::make_tuple(left, equal, right);
 }
 
-template <typename T, typename TCompare>
-std::ostream& operator<<(std::ostream& os, const AVLTree<T, TCompare> &tree){
-    tree.print(os);
-    return os;
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+std::pair<typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *, typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::extractMin(Node *subtree_root) {
+    subtree_root = own(subtree_root);
+    if (!subtree_root->left_child){
+        auto rest = subtree_root->right_child;
+        subtree_root->right_child = nullptr;
+        return std::make_pair(rest, subtree_root);
+    }
+
+    auto nodes = extractMin(subtree_root->left_child);
+    subtree_root->left_child = nodes.first;
+    return std::make_pair(recoverBalance(subtree_root), nodes.second);
 }
 
-template <typename T, typename TCompare>
-bool operator==(const AVLTree<T, TCompare> &tree, const std::set<T, TCompare> &set){
-    if (set.size() != tree.size()){
-        return false;
+//joins two trees, all values of left are less than values of right
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *AVLTree<T, TCompare, TAggregate, TLayout, TStats>::mergeAndBalance(Node *left, Node *right) {
+    if (!left){
+        return right;
+    }
+    if (!right){
+        return left;
     }
 
-    auto tree_it = AVLIterator(tree); // redo
-    auto set_it = set.begin();
-    for (; tree_it.currentNode() || set_it != set.end(); ++set_it, ++tree_it){
-        if (*tree_it != *set_it){
-            return false;
-        }
+    auto nodes = extractMin(right);
+    return mergeWithRootAndBalance(left, nodes.first, nodes.second);
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *AVLTree<T, TCompare, TAggregate, TLayout, TStats>::unite(Node *first, Node *second, Garbage &garbage, unsigned depth) {
+    if (!first){
+        return second;
+    }
+    if (!second){
+        return first;
     }
-    return set_it == set.end() && tree_it.next() == nullptr;
+
+    Node *second_left, *equal, *second_right;
+    std::tie(second_left, equal, second_right) = splitAround(second, first->value);
+    if (equal){
+        garbage.push_back(equal);
+    }
+
+    Node *left = first->left_child, *right = first->right_child;
+    bool parallel = depth > 0 && std::min(first->getSize(), second->getSize()) >= parallel_grain;
+    Garbage right_garbage;
+    forkJoin(parallel,
+             [&](){ left = unite(left, second_left, garbage, parallel ? depth - 1 : depth); },
+             [&](){ right = unite(right, second_right, parallel ? right_garbage : garbage, parallel ? depth - 1 : depth); });
+    garbage.insert(garbage.end(), right_garbage.begin(), right_garbage.end());
+    return mergeWithRootAndBalance(left, right, first);
 }
 
-template<typename T, typename TCompare>
-AVLTree<T, TCompare> setIntersection(const AVLTree<T, TCompare> &first, const AVLTree<T, TCompare> &second){
-    AVLTree<T, TCompare> intersection;
-    typename AVLTree<T, TCompare>::AVLIterator it1(first);
-    typename AVLTree<T, TCompare>::AVLIterator it2(second);
-    while(it1.currentNode() && it2.currentNode()){
-        T f_value = *it1;
-        T s_value = *it2;
-        if (f_value == s_value){
-            intersection.insert(f_value);
-            ++it1;
-            ++it2;
-        }
-        else if(f_value < s_value){
-            ++it1;
-        }
-        else{
-            ++it2;
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *AVLTree<T, TCompare, TAggregate, TLayout, TStats>::intersect(Node *first, Node *second, Garbage &garbage, unsigned depth) {
+    if (!first || !second){
+        garbage.push_back(first ? first : second);
+        return nullptr;
+    }
+
+    Node *second_left, *equal, *second_right;
+    std::tie(second_left, equal, second_right) = splitAround(second, first->value);
+
+    Node *left = first->left_child, *right = first->right_child;
+    bool parallel = depth > 0 && std::min(first->getSize(), second->getSize()) >= parallel_grain;
+    Garbage right_garbage;
+    forkJoin(parallel,
+             [&](){ left = intersect(left, second_left, garbage, parallel ? depth - 1 : depth); },
+             [&](){ right = intersect(right, second_right, parallel ? right_garbage : garbage, parallel ? depth - 1 : depth); });
+    garbage.insert(garbage.end(), right_garbage.begin(), right_garbage.end());
+
+    if (equal){
+        garbage.push_back(equal);
+        return mergeWithRootAndBalance(left, right, first);
+    }
+    first = own(first);
+    first->left_child = first->right_child = nullptr;
+    garbage.push_back(first);
+    return mergeAndBalance(left, right);
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *AVLTree<T, TCompare, TAggregate, TLayout, TStats>::subtract(Node *first, Node *second, Garbage &garbage, unsigned depth) {
+    if (!first || !second){
+        if (second){
+            garbage.push_back(second);
         }
+        return first;
     }
 
-    return intersection;
+    Node *second_left, *equal, *second_right;
+    std::tie(second_left, equal, second_right) = splitAround(second, first->value);
+
+    Node *left = first->left_child, *right = first->right_child;
+    bool parallel = depth > 0 && std::min(first->getSize(), second->getSize()) >= parallel_grain;
+    Garbage right_garbage;
+    forkJoin(parallel,
+             [&](){ left = subtract(left, second_left, garbage, parallel ? depth - 1 : depth); },
+             [&](){ right = subtract(right, second_right, parallel ? right_garbage : garbage, parallel ? depth - 1 : depth); });
+    garbage.insert(garbage.end(), right_garbage.begin(), right_garbage.end());
+
+    if (equal){
+        first = own(first);
+        first->left_child = first->right_child = nullptr;
+        garbage.push_back(first);
+        garbage.push_back(equal);
+        return mergeAndBalance(left, right);
+    }
+    return mergeWithRootAndBalance(left, right, first);
 }
 
-template<typename T, typename TCompare>
-AVLTree<T, TCompare> setUnion(const AVLTree<T, TCompare> &first, const AVLTree<T, TCompare> &second){
-    auto trees_union = AVLTree<T, TCompare>(first);
-    typename AVLTree<T, TCompare>::AVLIterator it(second);
-    while(it.currentNode()){
-        trees_union.insert(*it);
-        ++it;
+//links count sorted detached nodes into a perfectly balanced subtree
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *AVLTree<T, TCompare, TAggregate, TLayout, TStats>::linkBalanced(Node *const *nodes, size_t count) {
+    if (count == 0){
+        return nullptr;
     }
 
-    return trees_union;
+    size_t middle = count / 2;
+    auto subtree_root = nodes[middle];
+    subtree_root->left_child = linkBalanced(nodes, middle);
+    subtree_root->right_child = linkBalanced(nodes + middle + 1, count - middle - 1);
+    subtree_root->updateHeight();
+    subtree_root->updateSize();
+    return subtree_root;
 }
 
-template<typename T, typename TCompare>
-AVLTree<T, TCompare> setDifference(const AVLTree<T, TCompare> &first, const AVLTree<T, TCompare> &second){
-    auto trees_difference = AVLTree<T, TCompare>(first);
-    typename AVLTree<T, TCompare>::AVLIterator it(second);
-    while(it.currentNode()){
-        trees_difference.deleteIfExists(*it);
-        ++it;
+//ordinary insertion of a detached node, the node becomes garbage if its value is present
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *AVLTree<T, TCompare, TAggregate, TLayout, TStats>::insertNode(Node *subtree_root, Node *node, Garbage &garbage) {
+    SearchPath path;
+    if (descend(subtree_root, node->value, path)){
+        garbage.push_back(node);
+        return subtree_root;
     }
-    return trees_difference;
+    return ascend(path, node);
 }
 
-template<typename T, typename TCompare>
-bool operator ==(const AVLTree<T, TCompare> &lhs, const AVLTree<T, TCompare> &rhs){
-    if (lhs.size() != rhs.size()){
-        return false;
+//distributes sorted detached nodes between the subtrees, nodes with values already present become garbage
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::insertSorted(Node *subtree_root, Node *const *nodes, size_t count, Garbage &garbage, unsigned depth) {
+    if (count == 0){
+        return subtree_root;
+    }
+    if (!subtree_root){
+        return linkBalanced(nodes, count);
+    }
+    if (count == 1){
+        return insertNode(subtree_root, nodes[0], garbage);
     }
 
-    auto it1 = AVLIterator(lhs);
-    auto it2 = AVLIterator(rhs);
-    while(it1.currentNode() != nullptr){
-        if (*it1 != *it2){
-            return false;
-        }
-        ++it1;
-        ++it2;
+    auto less_end = std::partition_point(nodes, nodes + count, [&](const Node *node){
+        return cmp(node->value, subtree_root->value);
+    });
+    auto greater_begin = less_end;
+    if (greater_begin != nodes + count && !cmp(subtree_root->value, (*greater_begin)->value)){
+        garbage.push_back(*greater_begin++);
     }
-    return true;
+
+    Node *left = subtree_root->left_child, *right = subtree_root->right_child;
+    bool parallel = depth > 0 && count >= parallel_grain;
+    Garbage right_garbage;
+    forkJoin(parallel,
+             [&](){ left = insertSorted(left, nodes, less_end - nodes, garbage, parallel ? depth - 1 : depth); },
+             [&](){ right = insertSorted(right, greater_begin, nodes + count - greater_begin,
+                                         parallel ? right_garbage : garbage, parallel ? depth - 1 : depth); });
+    garbage.insert(garbage.end(), right_garbage.begin(), right_garbage.end());
+    return mergeWithRootAndBalance(left, right, subtree_root);
 }
 
-template<typename T, typename TCompare>
-bool operator !=(const AVLTree<T, TCompare> &lhs, const AVLTree<T, TCompare> &rhs){
-    return !(lhs == rhs);
+//distributes sorted values between the subtrees and removes the nodes holding them
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::Node *
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::eraseSorted(Node *subtree_root, const T *values, size_t count, Garbage &garbage, unsigned depth) {
+    if (!subtree_root || count == 0){
+        return subtree_root;
+    }
+
+    auto less_end = std::partition_point(values, values + count, [&](const T &value){
+        return cmp(value, subtree_root->value);
+    });
+    auto greater_begin = less_end;
+    bool found = greater_begin != values + count && !cmp(subtree_root->value, *greater_begin);
+    if (found){
+        ++greater_begin;
+    }
+
+    Node *left = subtree_root->left_child, *right = subtree_root->right_child;
+    bool parallel = depth > 0 && count >= parallel_grain;
+    Garbage right_garbage;
+    forkJoin(parallel,
+             [&](){ left = eraseSorted(left, values, less_end - values, garbage, parallel ? depth - 1 : depth); },
+             [&](){ right = eraseSorted(right, greater_begin, values + count - greater_begin,
+                                        parallel ? right_garbage : garbage, parallel ? depth - 1 : depth); });
+    garbage.insert(garbage.end(), right_garbage.begin(), right_garbage.end());
+
+    if (!found){
+        return mergeWithRootAndBalance(left, right, subtree_root);
+    }
+    subtree_root = own(subtree_root);
+    subtree_root->left_child = subtree_root->right_child = nullptr;
+    garbage.push_back(subtree_root);
+    return mergeAndBalance(left, right);
 }
 
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+template<class Iterator>
+size_t AVLTree<T, TCompare, TAggregate, TLayout, TStats>::insertBatch(Iterator first, Iterator last) {
+    beginUpdate();
+    vector<T> batch(first, last);
+    if (!isSortedUnique(batch)){
+        sortUnique(batch);
+    }
+    if (batch.empty()){
+        return 0;
+    }
 
-template<typename T, typename TCompare>
-typename AVLTree<T, TCompare>::AVLIterator &AVLTree<T, TCompare>::AVLIterator::operator++(){
-    if (current){
-        pushLeftBranch(current->right_child);
+    //nodes are allocated up front, the merge itself only relinks and may run in parallel
+    if (!pool){
+        pool = make_shared<Pool>();
+    }
+    vector<Node *> nodes;
+    nodes.reserve(batch.size());
+    for (auto &value : batch){
+        nodes.push_back(pool->create(std::move(value)));
+        nodes.back()->version = version;
     }
 
-    return *this;
+    size_t old_size = size();
+    Garbage garbage;
+    root = insertSorted(root, nodes.data(), nodes.size(), garbage, frozen_version ? 0 : parallelDepth());
+    destroy(garbage);
+    return size() - old_size;
 }
 
-template<typename T, typename TCompare>
-typename AVLTree<T, TCompare>::AVLIterator &AVLTree<T, TCompare>::AVLIterator::operator++(int){
-    AVLIterator copy = *this;
-    ++this;
-    return copy;
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+template<class Iterator>
+size_t AVLTree<T, TCompare, TAggregate, TLayout, TStats>::eraseBatch(Iterator first, Iterator last) {
+    beginUpdate();
+    vector<T> batch(first, last);
+    if (!isSortedUnique(batch)){
+        sortUnique(batch);
+    }
+
+    size_t old_size = size();
+    Garbage garbage;
+    root = eraseSorted(root, batch.data(), batch.size(), garbage, frozen_version ? 0 : parallelDepth());
+    destroy(garbage);
+    return old_size - size();
 }
 
-template<typename T, typename TCompare>
-AVLTree<T, TCompare>::AVLIterator::AVLIterator(const AVLTree<T>& tree){
-    pushLeftBranch(tree.root);
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+void AVLTree<T, TCompare, TAggregate, TLayout, TStats>::uniteWith(AVLTree &&other) {
+    beginUpdate();
+    auto other_root = takeNodes(other);
+    Garbage garbage;
+    //copying shared nodes allocates, so trees with snapshots are combined on one thread
+    root = unite(root, other_root, garbage, frozen_version ? 0 : parallelDepth());
+    destroy(garbage);
 }
 
-template<typename T, typename TCompare>
-typename AVLTree<T, TCompare>::AVLIterator &AVLTree<T, TCompare>::AVLIterator::operator=(const AVLTree<T, TCompare>::AVLIterator &other) {
-    if (*this != other){
-        this->nodes = other.nodes;
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+void AVLTree<T, TCompare, TAggregate, TLayout, TStats>::intersectWith(AVLTree &&other) {
+    beginUpdate();
+    auto other_root = takeNodes(other);
+    Garbage garbage;
+    //copying shared nodes allocates, so trees with snapshots are combined on one thread
+    root = intersect(root, other_root, garbage, frozen_version ? 0 : parallelDepth());
+    destroy(garbage);
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+void AVLTree<T, TCompare, TAggregate, TLayout, TStats>::subtract(AVLTree &&other) {
+    beginUpdate();
+    auto other_root = takeNodes(other);
+    Garbage garbage;
+    //copying shared nodes allocates, so trees with snapshots are combined on one thread
+    root = subtract(root, other_root, garbage, frozen_version ? 0 : parallelDepth());
+    destroy(garbage);
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+void AVLTree<T, TCompare, TAggregate, TLayout, TStats>::print(ostream &os) const {
+    os << "tree:\n";
+    if (root){
+        root->print(os);
     }
+    else{
+        os << "tree is empty";
+    }
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+std::pair<AVLTree<T, TCompare, TAggregate, TLayout, TStats>, AVLTree<T, TCompare, TAggregate, TLayout, TStats>> AVLTree<T, TCompare, TAggregate, TLayout, TStats>::split(AVLTree &tree, const T &value, bool left_is_strictly_Less) {
+    tree.beginUpdate();
+    auto nodes = tree.split(tree.root, value, left_is_strictly_Less);
+    tree.root = nullptr; //the nodes now belong to the halves
+    std::pair<AVLTree, AVLTree> halves(tree.sibling(nodes.first), tree.sibling(nodes.second));
+    halves.first.retired = std::move(tree.retired);
+    tree.retired.clear();
+    return halves;
+}
+
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::AVLTree(const initializer_list<T> &il, const TCompare &cmp)
+:AVLTree(vector<T>(il), cmp){}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+std::ostream& avl::operator<<(std::ostream& os, const AVLTree<T, TCompare, TAggregate, TLayout, TStats> &tree){
+    tree.print(os);
+    return os;
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+bool avl::operator==(const AVLTree<T, TCompare, TAggregate, TLayout, TStats> &tree, const std::set<T, TCompare> &set){
+    return set.size() == tree.size() && std::equal(tree.begin(), tree.end(), set.begin());
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats> avl::setIntersection(const AVLTree<T, TCompare, TAggregate, TLayout, TStats> &first, const AVLTree<T, TCompare, TAggregate, TLayout, TStats> &second){
+    AVLTree<T, TCompare, TAggregate, TLayout, TStats> intersection(first);
+    intersection.intersectWith(AVLTree<T, TCompare, TAggregate, TLayout, TStats>(second));
+    return intersection;
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats> avl::setUnion(const AVLTree<T, TCompare, TAggregate, TLayout, TStats> &first, const AVLTree<T, TCompare, TAggregate, TLayout, TStats> &second){
+    AVLTree<T, TCompare, TAggregate, TLayout, TStats> trees_union(first);
+    trees_union.uniteWith(AVLTree<T, TCompare, TAggregate, TLayout, TStats>(second));
+    return trees_union;
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats> avl::setDifference(const AVLTree<T, TCompare, TAggregate, TLayout, TStats> &first, const AVLTree<T, TCompare, TAggregate, TLayout, TStats> &second){
+    AVLTree<T, TCompare, TAggregate, TLayout, TStats> trees_difference(first);
+    trees_difference.subtract(AVLTree<T, TCompare, TAggregate, TLayout, TStats>(second));
+    return trees_difference;
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats> avl::setIntersection(AVLTree<T, TCompare, TAggregate, TLayout, TStats> &&first, AVLTree<T, TCompare, TAggregate, TLayout, TStats> &&second){
+    first.intersectWith(std::move(second));
+    return std::move(first);
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats> avl::setUnion(AVLTree<T, TCompare, TAggregate, TLayout, TStats> &&first, AVLTree<T, TCompare, TAggregate, TLayout, TStats> &&second){
+    first.uniteWith(std::move(second));
+    return std::move(first);
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats> avl::setDifference(AVLTree<T, TCompare, TAggregate, TLayout, TStats> &&first, AVLTree<T, TCompare, TAggregate, TLayout, TStats> &&second){
+    first.subtract(std::move(second));
+    return std::move(first);
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+bool avl::operator ==(const AVLTree<T, TCompare, TAggregate, TLayout, TStats> &lhs, const AVLTree<T, TCompare, TAggregate, TLayout, TStats> &rhs){
+    return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin());
+}
+
+template<typename T, typename TCompare, typename THash, typename TLayout, typename TStats>
+bool avl::probablyEqual(const AVLTree<T, TCompare, MerkleHash<T, THash>, TLayout, TStats> &lhs, const AVLTree<T, TCompare, MerkleHash<T, THash>, TLayout, TStats> &rhs){
+    return lhs.size() == rhs.size() && lhs.aggregate() == rhs.aggregate();
+}
+
+template<typename T, typename TCompare, typename THash, typename TLayout, typename TStats>
+bool avl::operator ==(const AVLTree<T, TCompare, MerkleHash<T, THash>, TLayout, TStats> &lhs, const AVLTree<T, TCompare, MerkleHash<T, THash>, TLayout, TStats> &rhs){
+    //equal hashes may still be a collision
+    return probablyEqual(lhs, rhs) && std::equal(lhs.begin(), lhs.end(), rhs.begin());
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+bool avl::operator !=(const AVLTree<T, TCompare, TAggregate, TLayout, TStats> &lhs, const AVLTree<T, TCompare, TAggregate, TLayout, TStats> &rhs){
+    return !(lhs == rhs);
+}
+
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::AVLIterator::AVLIterator(const Node *root, bool at_end)
+        :root(root){
+    if (!at_end){
+        pushLeftBranch(root);
+    }
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+AVLTree<T, TCompare, TAggregate, TLayout, TStats>::AVLIterator::AVLIterator(const AVLIterator &other)
+        :root(other.root)
+        ,length(other.length){
+    std::copy(other.path, other.path + other.length, path);
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::AVLIterator &AVLTree<T, TCompare, TAggregate, TLayout, TStats>::AVLIterator::operator=(const AVLIterator &other) {
+    root = other.root;
+    length = other.length;
+    std::copy(other.path, other.path + other.length, path);
+    return *this;
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::AVLIterator &AVLTree<T, TCompare, TAggregate, TLayout, TStats>::AVLIterator::operator++(){
+    auto node = path[length - 1];
+    if (node->right_child){
+        pushLeftBranch(node->right_child);
+        return *this;
+    }
+
+    //climb until coming up from a left child, the path empties past the last value
+    do{
+        node = path[--length];
+    } while (length && path[length - 1]->right_child == node);
     return *this;
 }
 
-template<typename T, typename TCompare>
-void AVLTree<T, TCompare>::AVLIterator::pushLeftBranch(typename AVLTree<T, TCompare>::Node::sNode current_node) {
-    while(current_node){
-        nodes.push(current_node);
-        current_node = current_node->left_child;
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+typename AVLTree<T, TCompare, TAggregate, TLayout, TStats>::AVLIterator &AVLTree<T, TCompare, TAggregate, TLayout, TStats>::AVLIterator::operator--(){
+    if (!length){
+        pushRightBranch(root);
+        return *this;
     }
 
-    if (nodes.empty()){
-        current = nullptr;
+    auto node = path[length - 1];
+    if (node->left_child){
+        pushRightBranch(node->left_child);
+        return *this;
     }
-    else{
-        current = nodes.top();
-        nodes.pop();
+
+    do{
+        node = path[--length];
+    } while (length && path[length - 1]->left_child == node);
+    return *this;
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+void AVLTree<T, TCompare, TAggregate, TLayout, TStats>::AVLIterator::pushLeftBranch(const Node *node) {
+    while (node){
+        path[length++] = node;
+        node = node->left_child;
+    }
+}
+
+template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+void AVLTree<T, TCompare, TAggregate, TLayout, TStats>::AVLIterator::pushRightBranch(const Node *node) {
+    while (node){
+        path[length++] = node;
+        node = node->right_child;
     }
-}
\ No newline at end of file
+}
@@ -8,32 +8,91 @@
 #include <stack>
 #include <set>
 #include <iostream>
+#include <type_traits>
+#include <algorithm>
+#include <iterator>
+#include <tuple>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <limits>
+#include <utility>
+
+#include "NodePool.h"
+#include "Parallel.h"
+#include "FrozenSet.h"
+#include "Storage.h"
+#include "Aggregate.h"
+#include "Layout.h"
+#include "Stats.h"
 
 namespace avl{
-    template<class T, class TCompare = std::less<T>>
+    //marks constructor input that is already sorted by TCompare and has no duplicates
+    struct SortedUniqueTag{};
+
+    constexpr SortedUniqueTag sortedUnique{};
+
+    //versions stamp nodes for copy-on-write snapshots, unique across all trees
+    inline uint64_t nextVersion(){
+        static std::atomic<uint64_t> counter(0);
+        return ++counter;
+    }
+
+    //most nodes on a root-to-leaf path of an AVL tree of at most max_size values:
+    //a tree of height h holds at least m(h) = m(h - 1) + m(h - 2) + 1 values
+    constexpr size_t avlHeightBound(uint64_t max_size){
+        size_t height = 1;
+        uint64_t shorter = 0;
+        uint64_t smallest = 1;
+        while (smallest < max_size && max_size - smallest - 1 >= shorter){
+            uint64_t next = smallest + shorter + 1;
+            shorter = smallest;
+            smallest = next;
+            ++height;
+        }
+        return height;
+    }
+
+    template<class K, class V, class TAggregate, class TCompare>
+    class AVLMap;
+
+    //TAggregate is an aggregate policy from Aggregate.h kept for every subtree, NoAggregate by default.
+    //TLayout is a node layout policy from Layout.h, PointerLayout by default.
+    //TStats is a statistics policy from Stats.h, NoStats by default
+    template<class T, class TCompare = std::less<T>, class TAggregate = NoAggregate, class TLayout = PointerLayout,
+             class TStats = NoStats>
     class AVLTree {
     private:
-        //node
-        struct Node{
-            using sNode = std::shared_ptr<Node>;
+        template<class K, class V, class A, class C>
+        friend class AVLMap;
 
-            T value;
+        //node, the value comes last so small values fill the padding after the height
+        struct Node : SubtreeAggregate<TAggregate, T>, TLayout::NodeBase{
+            using Link = typename TLayout::template link<Node>;
+
+            Link left_child;
+
+            Link right_child;
 
-            sNode left_child;
+            typename TLayout::size_type subtree_size = 1;
 
-            sNode right_child;
+            typename TLayout::version_type version = 0;
 
-            unsigned int subtree_height = 1;
+            typename TLayout::height_type subtree_height = 1;
 
-            size_t subtree_size = 1;
+            T value;
 
         public:
-            explicit Node(const T &value, const sNode &left_child = nullptr,
-                          const sNode &right_child = nullptr);
+            explicit Node(const T &value, Node *left_child = nullptr,
+                          Node *right_child = nullptr);
 
-            Node &operator=(const Node &other);
+            explicit Node(T &&value, Node *left_child = nullptr,
+                          Node *right_child = nullptr);
 
-            Node(const Node &other);
+            template<class... Args>
+            explicit Node(std::piecewise_construct_t, Args&&... args);
 
             bool hasLeftChild() const noexcept{ return left_child!= nullptr; }
 
@@ -55,101 +114,553 @@ namespace avl{
 
             friend std::ostream& operator<<(std::ostream& os, const Node &node);
 
-            sNode deepCopy() const;
+            Node *deepCopy(typename TLayout::template pool<Node> &pool) const;
+        };
+
+        using Pool = typename TLayout::template pool<Node>;
+
+        //node removed from the tree while snapshots may still reach it
+        struct Retired{
+            uint64_t version;
+
+            Node *node;
+
+            bool whole_subtree;
         };
 
+        //shared by a tree, the trees split from it and its snapshots
+        struct SnapshotRegistry{
+            std::mutex mutex;
+
+            std::multiset<uint64_t> versions;
+
+            //nodes left by destroyed or cleared trees, freed with the last snapshot
+            std::vector<Retired> orphans;
+
+            std::shared_ptr<Pool> orphan_pool;
+
+            ~SnapshotRegistry();
+        };
+
+        //bound on root-to-leaf paths, 91 nodes for 64-bit sizes and 45 for 32-bit ones
+        static const size_t max_path_length = avlHeightBound(std::numeric_limits<typename TLayout::size_type>::max());
+
     public:
-        //iterator
-        struct AVLIterator{
+        class Snapshot;
+
+        //bidirectional in-order iterator, the path from the root is kept inline so steps never allocate.
+        //valid until the tree is changed, iterators of a snapshot stay valid as long as the snapshot
+        class AVLIterator{
         private:
-            std::stack<typename Node::sNode> nodes;
+            friend class AVLTree;
+
+            friend class Snapshot;
 
-            typename Node::sNode current;
+            const Node *root = nullptr;
 
-            void pushLeftBranch(typename Node::sNode node);
+            //path[0] is the root and path[length - 1] the current node, empty at the end
+            const Node *path[max_path_length];
+
+            size_t length = 0;
+
+            AVLIterator(const Node *root, bool at_end);
+
+            void pushLeftBranch(const Node *node);
+
+            void pushRightBranch(const Node *node);
 
         public:
-            explicit AVLIterator(const AVLTree<T>& tree);
+            using iterator_category = std::bidirectional_iterator_tag;
+
+            using value_type = T;
 
-            T operator*() { return current->getValue(); }
+            using difference_type = std::ptrdiff_t;
 
-            AVLIterator & operator=(const AVLIterator &other);
+            using pointer = const T *;
 
-            AVLIterator & operator++();
+            using reference = const T &;
 
-            AVLIterator &operator++ (int);
+            AVLIterator() = default;
 
-            typename Node::sNode currentNode() { return current; } //redo
+            AVLIterator(const AVLIterator &other);
+
+            AVLIterator &operator=(const AVLIterator &other);
+
+            reference operator*() const { return path[length - 1]->value; }
+
+            pointer operator->() const { return &path[length - 1]->value; }
+
+            AVLIterator &operator++();
+
+            AVLIterator operator++(int) { AVLIterator copy(*this); ++*this; return copy; }
+
+            AVLIterator &operator--();
+
+            AVLIterator operator--(int) { AVLIterator copy(*this); --*this; return copy; }
+
+            bool operator==(const AVLIterator &other) const {
+                return (length ? path[length - 1] : nullptr) == (other.length ? other.path[other.length - 1] : nullptr);
+            }
+
+            bool operator!=(const AVLIterator &other) const { return !(*this == other); }
         };
 
-        using sNode = std::shared_ptr<Node>;
+        using iterator = AVLIterator;
+
+        using const_iterator = AVLIterator;
+
+        using reverse_iterator = std::reverse_iterator<AVLIterator>;
+
+        using const_reverse_iterator = reverse_iterator;
+
+        //immutable O(1) view of the tree, safe to read while the tree keeps changing
+        class Snapshot{
+        private:
+            friend class AVLTree;
+
+            Node *root;
+
+            std::shared_ptr<Pool> pool;
+
+            std::shared_ptr<SnapshotRegistry> registry;
+
+            uint64_t version;
+
+            TCompare cmp;
+
+            Snapshot(Node *root, const std::shared_ptr<Pool> &pool,
+                     const std::shared_ptr<SnapshotRegistry> &registry, uint64_t version, const TCompare &cmp);
+
+        public:
+            Snapshot(const Snapshot &other);
 
-        sNode root;
+            Snapshot &operator=(const Snapshot &other);
+
+            ~Snapshot();
+
+            size_t size() const { return root ? root->getSize() : 0; }
+
+            size_t height() const { return root ? root->getHeight() : 0; }
+
+            bool contains(const T &value) const { return findNode(root, value, cmp) != nullptr; }
+
+            template<class K, class C = TCompare, class = typename C::is_transparent>
+            bool contains(const K &value) const { return findNode(root, value, cmp) != nullptr; }
+
+            const T *find(const T &value) const { return valueOf(findNode(root, value, cmp)); }
+
+            template<class K, class C = TCompare, class = typename C::is_transparent>
+            const T *find(const K &value) const { return valueOf(findNode(root, value, cmp)); }
+
+            std::vector<T> toArray() const;
+
+            AVLIterator begin() const { return AVLIterator(root, false); }
+
+            AVLIterator end() const { return AVLIterator(root, true); }
+
+            reverse_iterator rbegin() const { return reverse_iterator(end()); }
+
+            reverse_iterator rend() const { return reverse_iterator(begin()); }
+
+            const T &select(size_t k) const { return selectNode(root, k)->value; }
+
+            size_t rank(const T &value) const { return countLess(root, value, cmp, false); }
+
+            size_t countInRange(const T &lo, const T &hi) const { return AVLTree::countInRange(root, lo, hi, cmp); }
+
+            template<class A = TAggregate>
+            typename A::value_type aggregate(const T &lo, const T &hi) const { return aggregateRange(root, lo, hi, cmp); }
+
+            const T *lowerBound(const T &value) const { return valueOf(boundNode(root, value, cmp, false)); }
+
+            const T *upperBound(const T &value) const { return valueOf(boundNode(root, value, cmp, true)); }
+
+            FrozenSet<T, TCompare> freeze() const { return FrozenSet<T, TCompare>(toArray(), cmp); }
+        };
+
+        //nodes are owned by the pool, trees produced by split share the pool of the source tree.
+        //the pool is not synchronized, so trees sharing it are not changed from different threads at once
+        std::shared_ptr<Pool> pool;
+
+        Node *root;
 
         TCompare cmp;
 
-        static sNode recoverBalance(sNode subtree_root); //static vs non-static
+        std::shared_ptr<SnapshotRegistry> registry;
+
+        //nodes with a smaller version may be reachable from snapshots and are copied before changes
+        uint64_t frozen_version = 0;
+
+        //version of the nodes created by this tree
+        uint64_t version = 0;
+
+        std::deque<Retired> retired;
+
+        //path to the value touched by the last finger operation, emptied by every other update
+        std::unique_ptr<AVLIterator> finger;
+
+        //updated by const searches as well, a new tree starts from zero
+        mutable TStats stats;
+
+        AVLTree(Node *root, const std::shared_ptr<Pool> &pool, const TCompare &cmp);
+
+        //tree of nodes cut from this one, sharing its pool and snapshots
+        AVLTree sibling(Node *subtree_root) const;
+
+        template<class K>
+        Node *cutRange(const K &lo, const K &hi);
+
+        void beginUpdate(){
+            if (frozen_version){
+                collectRetired();
+            }
+            if (finger){
+                finger->length = 0;
+            }
+        }
+
+        void collectRetired();
+
+        bool isShared(const Node *node) const noexcept { return node->version < frozen_version; }
+
+        Node *own(Node *node);
+
+        void release(Node *node);
+
+        void releaseSubtree(Node *subtree_root);
+
+        void freeRetired(const Retired &entry);
+
+        static const Node *selectNode(const Node *subtree_root, size_t k);
+
+        static size_t countLess(const Node *subtree_root, const T &value, const TCompare &cmp, bool or_equal);
+
+        static size_t countInRange(const Node *subtree_root, const T &lo, const T &hi, const TCompare &cmp);
+
+        static const Node *boundNode(const Node *subtree_root, const T &value, const TCompare &cmp, bool strictly_greater);
+
+        static const T *valueOf(const Node *node) { return node ? &node->value : nullptr; }
+
+        template<class Above, class Below, class F>
+        static void visitWhere(const Node *subtree_root, const Above &above, const Below &below, F &f);
+
+        template<class F>
+        static void visitRange(const Node *subtree_root, const T &lo, const T &hi, const TCompare &cmp, F &f);
 
-        sNode insert(sNode &subtree_root, const T &value);
+        template<class A = TAggregate>
+        static typename A::value_type aggregateOf(const Node *node) { return node ? node->aggregate : A::identity(); }
 
-        sNode findNode(const T &value, sNode subtree_root);
+        template<class A, class Above, class Below>
+        static typename A::value_type aggregateWhere(const Node *subtree_root, const Above &above, const Below &below);
 
-        sNode deleteIfExists(const T &value, sNode &subtree_root);
+        template<class K, class A = TAggregate>
+        static typename A::value_type aggregateRange(const Node *subtree_root, const K &lo, const K &hi, const TCompare &cmp);
 
-        static sNode leftRotate(sNode k2);
+        template<class A>
+        void diffBetween(const Node *subtree_root, const T *lo, const T *hi, const AVLTree &other,
+                         std::vector<T> &only_here, std::vector<T> &only_there) const;
 
-        static sNode rightRotate(sNode k2);
+        template<class... Args>
+        Node *createNode(Args&&... args);
+
+        void destroySubtree(Node *subtree_root);
+
+        Node *recoverBalance(Node *subtree_root);
+
+        //root-to-leaf path of an iterative update
+        struct SearchPath{
+            Node *nodes[max_path_length];
+
+            bool went_left[max_path_length];
+
+            size_t length = 0;
+        };
+
+        template<class K>
+        Node *descend(Node *subtree_root, const K &value, SearchPath &path) const;
+
+        Node *ascend(const SearchPath &path, Node *child, AVLIterator *position = nullptr);
+
+        template<class K>
+        static const Node *findNode(const Node *subtree_root, const K &value, const TCompare &cmp, TStats *stats = nullptr);
+
+        template<class K>
+        Node *descendNear(const AVLIterator &start, const K &value, SearchPath &path) const;
+
+        AVLIterator &fingerPath();
+
+        template<class V>
+        bool insertValue(V &&value);
+
+        template<class V>
+        AVLIterator insertNear(const AVLIterator &start, V &&value, bool &inserted);
+
+        template<class V>
+        bool insertAtFinger(V &&value);
+
+        template<class K>
+        bool eraseValue(const K &value);
+
+        Node *leftRotate(Node *k2);
+
+        Node *rightRotate(Node *k2);
+
+        bool isSortedUnique(const std::vector<T> &elements) const;
+
+        void sortUnique(std::vector<T> &elements) const;
+
+        template<class Iterator>
+        Node *buildBalanced(Iterator first, size_t count, Pool &target, unsigned depth);
+
+        template<class Iterator>
+        void assignSortedUnique(Iterator first, size_t count);
+
+        static AVLTree fromStoredValues(const T *values, size_t count, const TCompare &cmp);
+
+        //roots of detached subtrees to be destroyed after a parallel section
+        using Garbage = std::vector<Node *>;
+
+        void destroy(Garbage &garbage);
+
+        Node *takeNodes(AVLTree &other);
+
+        std::tuple<Node *, Node *, Node *> splitAround(Node *subtree_root, const T &value);
+
+        std::pair<Node *, Node *> extractMin(Node *subtree_root);
+
+        Node *mergeAndBalance(Node *left, Node *right);
+
+        Node *unite(Node *first, Node *second, Garbage &garbage, unsigned depth);
+
+        Node *intersect(Node *first, Node *second, Garbage &garbage, unsigned depth);
+
+        Node *subtract(Node *first, Node *second, Garbage &garbage, unsigned depth);
+
+        Node *linkBalanced(Node *const *nodes, size_t count);
+
+        Node *insertNode(Node *subtree_root, Node *node, Garbage &garbage);
+
+        Node *insertSorted(Node *subtree_root, Node *const *nodes, size_t count, Garbage &garbage, unsigned depth);
+
+        Node *eraseSorted(Node *subtree_root, const T *values, size_t count, Garbage &garbage, unsigned depth);
 
     public:
-        explicit AVLTree(sNode root = nullptr, const TCompare &cmp = TCompare());
+        explicit AVLTree(const TCompare &cmp = TCompare());
 
         explicit AVLTree(const std::vector<T> &elements, const TCompare &cmp = TCompare());
 
+        explicit AVLTree(std::vector<T> &&elements, const TCompare &cmp = TCompare());
+
+        AVLTree(SortedUniqueTag, const std::vector<T> &elements, const TCompare &cmp = TCompare());
+
         AVLTree(const std::initializer_list<T> &il, const TCompare &cmp = TCompare());
 
         AVLTree &operator=(const AVLTree &other);
 
+        AVLTree &operator=(AVLTree &&other) noexcept;
+
         AVLTree(const AVLTree &other);
 
+        AVLTree(AVLTree &&other) noexcept;
+
+        ~AVLTree();
+
+        void clear();
+
         size_t size() const { return root ? root->getSize() : 0; }
 
         size_t height() const { return root ? root->getHeight() : 0; }
 
-        void insert(const T &value) { root = insert(root, value); }
+        //bytes taken by one node, for memory estimates
+        static constexpr size_t nodeSize() { return sizeof(Node); }
+
+        //iterative updates, return false if the value was already present or missing
+        bool insert(const T &value) { return insertValue(value); }
+
+        bool insert(T &&value) { return insertValue(std::move(value)); }
+
+        //constructs the value in its node, the node is dropped if an equal value is present
+        template<class... Args>
+        bool emplace(Args&&... args);
+
+        //hinted insertion, the search climbs from hint and costs O(log d) comparisons for a value
+        //d positions away. end() stands for the largest value, so appends are O(1) comparisons.
+        //returns the iterator at the value, whether inserted or already present
+        iterator insert(const_iterator hint, const T &value) { bool inserted; return insertNear(hint, value, inserted); }
 
-        bool contains(const T &value) { return findNode(value, root) != nullptr; }
+        iterator insert(const_iterator hint, T &&value) { bool inserted; return insertNear(hint, std::move(value), inserted); }
 
-        bool deleteIfExists(const T &value) { return deleteIfExists(value, root) != nullptr; }
+        //finger search: starts from the value touched by the previous insertNear or containsNear,
+        //or from the largest value after any other update. not safe to call concurrently
+        bool insertNear(const T &value) { return insertAtFinger(value); }
+
+        bool insertNear(T &&value) { return insertAtFinger(std::move(value)); }
+
+        bool containsNear(const T &value);
+
+        bool deleteIfExists(const T &value) { return eraseValue(value); }
+
+        bool contains(const T &value) const { return findNode(root, value, cmp, &stats) != nullptr; }
+
+        //nullptr if there is no equal value
+        const T *find(const T &value) const { return valueOf(findNode(root, value, cmp, &stats)); }
+
+        //heterogeneous lookup for transparent comparators such as std::less<>
+        template<class K, class C = TCompare, class = typename C::is_transparent>
+        bool contains(const K &value) const { return findNode(root, value, cmp, &stats) != nullptr; }
+
+        template<class K, class C = TCompare, class = typename C::is_transparent>
+        const T *find(const K &value) const { return valueOf(findNode(root, value, cmp, &stats)); }
+
+        template<class K, class C = TCompare, class = typename C::is_transparent>
+        bool deleteIfExists(const K &value) { return eraseValue(value); }
+
+        //later changes copy the nodes they touch instead of modifying them in place
+        Snapshot snapshot();
+
+        //counters of the statistics policy
+        const TStats &statistics() const { return stats; }
+
+        TStats &statistics() { return stats; }
+
+        //nodes and bytes held by the pool, which trees split from this one share
+        size_t allocatedNodes() const { return pool ? pool->size() : 0; }
+
+        size_t allocatedBytes() const { return pool ? pool->bytes() : 0; }
+
+        //order statistics, O(log n) through subtree sizes
+        //k-th smallest value, 0-based, throws std::out_of_range
+        const T &select(size_t k) const { return selectNode(root, k)->value; }
+
+        //number of values less than value
+        size_t rank(const T &value) const { return countLess(root, value, cmp, false); }
+
+        //number of values in [lo, hi]
+        size_t countInRange(const T &lo, const T &hi) const { return countInRange(root, lo, hi, cmp); }
+
+        //calls f for every value in [lo, hi] in order, O(log n + k)
+        template<class F>
+        void forEachInRange(const T &lo, const T &hi, F f) const { visitRange(root, lo, hi, cmp, f); }
+
+        //combined aggregate of the values in [lo, hi] in order, O(log n), only with an aggregate policy
+        template<class A = TAggregate>
+        typename A::value_type aggregate(const T &lo, const T &hi) const { return aggregateRange(root, lo, hi, cmp); }
+
+        //aggregate of the whole tree, O(1)
+        template<class A = TAggregate>
+        typename A::value_type aggregate() const { return aggregateOf(root); }
+
+        //values only in this tree and values only in other, both in order, for trees hashed with MerkleHash.
+        //subtrees whose hash matches the same key range of other are skipped, O(d log^2 n) for d differences
+        template<class A = TAggregate>
+        std::pair<std::vector<T>, std::vector<T>> diff(const AVLTree &other) const;
+
+        //first value not less than value, nullptr if there is none
+        const T *lowerBound(const T &value) const { return valueOf(boundNode(root, value, cmp, false)); }
+
+        //first value greater than value, nullptr if there is none
+        const T *upperBound(const T &value) const { return valueOf(boundNode(root, value, cmp, true)); }
+
+        //read-only copy in a cache-friendly array layout, O(n)
+        FrozenSet<T, TCompare> freeze() const { return FrozenSet<T, TCompare>(toArray(), cmp); }
 
         void print(std::ostream &os) const;
 
         std::vector<T> toArray() const;
 
-        static std::pair<sNode, sNode> split(sNode  subtree_root, const T &value, bool left_is_strictly_Less);
+        //binary format for trivially copyable T: a FileHeader followed by the values in order.
+        //loading checks the header and the order and throws std::runtime_error on a bad file
+        void save(std::ostream &os) const;
+
+        static AVLTree load(std::istream &is, const TCompare &cmp = TCompare());
+
+        //builds the tree straight from the file mapped into memory, without parsing the values
+        static AVLTree loadMapped(const std::string &path, const TCompare &cmp = TCompare());
+
+        //in-order traversal, usable with range-for and <algorithm>
+        AVLIterator begin() const { return AVLIterator(root, false); }
+
+        AVLIterator end() const { return AVLIterator(root, true); }
+
+        reverse_iterator rbegin() const { return reverse_iterator(end()); }
+
+        reverse_iterator rend() const { return reverse_iterator(begin()); }
+
+        //join-based set operations, other's nodes are reused, O(m log(n/m + 1)) work
+        void uniteWith(AVLTree &&other);
+
+        void intersectWith(AVLTree &&other);
+
+        void subtract(AVLTree &&other);
+
+        //batch updates: the batch is sorted once and merged in a single pass, O(k log(n/k + 1)) work
+        //return the number of values actually inserted or erased
+        template<class Iterator>
+        size_t insertBatch(Iterator first, Iterator last);
 
+        template<class Iterator>
+        size_t eraseBatch(Iterator first, Iterator last);
+
+        //removes the values in [lo, hi] in O(log n), their nodes are recycled lazily
+        void eraseRange(const T &lo, const T &hi);
+
+        //moves the values in [lo, hi] into a new tree in O(log n). the new tree shares the pool of this one,
+        //so the two are not changed from different threads at once unless one of them is copied first
+        AVLTree extractRange(const T &lo, const T &hi);
+
+        //bounds of another type for transparent comparators
+        template<class K, class C = TCompare, class = typename C::is_transparent>
+        void eraseRange(const K &lo, const K &hi) { releaseSubtree(cutRange(lo, hi)); }
+
+        template<class K, class C = TCompare, class = typename C::is_transparent>
+        AVLTree extractRange(const K &lo, const K &hi) { return sibling(cutRange(lo, hi)); }
+
+        template<class K>
+        std::pair<Node *, Node *> split(Node *subtree_root, const K &value, bool left_is_strictly_Less);
+
+        //moves the values less than value (or not greater, if !left_is_strictly_Less) into the first tree
+        //and the rest into the second, tree is left empty, O(log n). the halves share the pool of tree,
+        //which is not thread-safe: to change them from different threads, copy one, a copy has a pool of its own
         static std::pair<AVLTree, AVLTree> split(AVLTree &tree, const T &value, bool left_is_strictly_Less);
 
-        static sNode mergeWithRootAndBalance(sNode left, sNode right, sNode subtree_root);
+        Node *mergeWithRootAndBalance(Node *left, Node *right, Node *subtree_root, size_t depth = 0);
     };
 
-    template <typename T, typename TCompare>
-    std::ostream& operator<<(std::ostream& os, const AVLTree<T, TCompare> &tree);
+    template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+    std::ostream& operator<<(std::ostream& os, const AVLTree<T, TCompare, TAggregate, TLayout, TStats> &tree);
+
+    template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+    bool operator==(const AVLTree<T, TCompare, TAggregate, TLayout, TStats> &tree, const std::set<T, TCompare> &set);
+
+    template<typename T, typename TCompare = std::less<T>, typename TAggregate = NoAggregate, typename TLayout = PointerLayout, typename TStats = NoStats>
+    AVLTree<T, TCompare, TAggregate, TLayout, TStats> setIntersection(const AVLTree<T, TCompare, TAggregate, TLayout, TStats> &first, const AVLTree<T, TCompare, TAggregate, TLayout, TStats> &second);
+
+    template<typename T, typename TCompare = std::less<T>, typename TAggregate = NoAggregate, typename TLayout = PointerLayout, typename TStats = NoStats>
+    AVLTree<T, TCompare, TAggregate, TLayout, TStats> setUnion(const AVLTree<T, TCompare, TAggregate, TLayout, TStats> &first, const AVLTree<T, TCompare, TAggregate, TLayout, TStats> &second);
+
+    template<typename T, typename TCompare = std::less<T>, typename TAggregate = NoAggregate, typename TLayout = PointerLayout, typename TStats = NoStats>
+    AVLTree<T, TCompare, TAggregate, TLayout, TStats> setDifference(const AVLTree<T, TCompare, TAggregate, TLayout, TStats> &first, const AVLTree<T, TCompare, TAggregate, TLayout, TStats> &second);
+
+    template<typename T, typename TCompare = std::less<T>, typename TAggregate = NoAggregate, typename TLayout = PointerLayout, typename TStats = NoStats>
+    AVLTree<T, TCompare, TAggregate, TLayout, TStats> setIntersection(AVLTree<T, TCompare, TAggregate, TLayout, TStats> &&first, AVLTree<T, TCompare, TAggregate, TLayout, TStats> &&second);
 
-    template <typename T, typename TCompare>
-    bool operator==(const AVLTree<T, TCompare> &tree, const std::set<T> &set);
+    template<typename T, typename TCompare = std::less<T>, typename TAggregate = NoAggregate, typename TLayout = PointerLayout, typename TStats = NoStats>
+    AVLTree<T, TCompare, TAggregate, TLayout, TStats> setUnion(AVLTree<T, TCompare, TAggregate, TLayout, TStats> &&first, AVLTree<T, TCompare, TAggregate, TLayout, TStats> &&second);
 
-    template<typename T, typename TCompare = std::less<T>>
-    AVLTree<T, TCompare> setIntersection(const AVLTree<T, TCompare> &first, const AVLTree<T, TCompare> &second);
+    template<typename T, typename TCompare = std::less<T>, typename TAggregate = NoAggregate, typename TLayout = PointerLayout, typename TStats = NoStats>
+    AVLTree<T, TCompare, TAggregate, TLayout, TStats> setDifference(AVLTree<T, TCompare, TAggregate, TLayout, TStats> &&first, AVLTree<T, TCompare, TAggregate, TLayout, TStats> &&second);
 
-    template<typename T, typename TCompare = std::less<T>>
-    AVLTree<T, TCompare> setUnion(const AVLTree<T, TCompare> &first, const AVLTree<T, TCompare> &second);
+    template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+    bool operator ==(const AVLTree<T, TCompare, TAggregate, TLayout, TStats> &lhs, const AVLTree<T, TCompare, TAggregate, TLayout, TStats> &rhs);
 
-    template<typename T, typename TCompare = std::less<T>>
-    AVLTree<T, TCompare> setDifference(const AVLTree<T, TCompare> &first, const AVLTree<T, TCompare> &second);
+    //O(1) through the root hashes, false when the trees differ, true when they are equal or the hashes collide
+    template<typename T, typename TCompare, typename THash, typename TLayout, typename TStats>
+    bool probablyEqual(const AVLTree<T, TCompare, MerkleHash<T, THash>, TLayout, TStats> &lhs, const AVLTree<T, TCompare, MerkleHash<T, THash>, TLayout, TStats> &rhs);
 
-    template<typename T, typename TCompare>
-    bool operator ==(const AVLTree<T, TCompare> &lhs, const AVLTree<T, TCompare> &rhs);
+    //O(1) when the root hashes differ, otherwise confirmed value by value in O(n)
+    template<typename T, typename TCompare, typename THash, typename TLayout, typename TStats>
+    bool operator ==(const AVLTree<T, TCompare, MerkleHash<T, THash>, TLayout, TStats> &lhs, const AVLTree<T, TCompare, MerkleHash<T, THash>, TLayout, TStats> &rhs);
 
-    template<typename T, typename TCompare>
-    bool operator !=(const AVLTree<T, TCompare> &lhs, const AVLTree<T, TCompare> &rhs);
+    template<typename T, typename TCompare, typename TAggregate, typename TLayout, typename TStats>
+    bool operator !=(const AVLTree<T, TCompare, TAggregate, TLayout, TStats> &lhs, const AVLTree<T, TCompare, TAggregate, TLayout, TStats> &rhs);
 }
\ No newline at end of file
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <functional>
+#include <cstdint>
+
+namespace avl{
+    //aggregate policies describe a monoid kept in every node for its subtree:
+    //value_type, identity(), an associative combine(left, right) and lift(value) for a single value.
+    //combine is applied in key order, so it does not need to be commutative
+
+    //the default policy, nodes keep no aggregate
+    struct NoAggregate{};
+
+    template<class T>
+    struct SumOf{
+        using value_type = T;
+
+        static value_type identity() { return value_type(); }
+
+        static value_type combine(const value_type &left, const value_type &right) { return left + right; }
+
+        static value_type lift(const T &value) { return value; }
+    };
+
+    template<class T>
+    struct MinOf{
+        using value_type = T;
+
+        static value_type identity() { return std::numeric_limits<T>::max(); }
+
+        static value_type combine(const value_type &left, const value_type &right) { return std::min(left, right); }
+
+        static value_type lift(const T &value) { return value; }
+    };
+
+    template<class T>
+    struct MaxOf{
+        using value_type = T;
+
+        static value_type identity() { return std::numeric_limits<T>::lowest(); }
+
+        static value_type combine(const value_type &left, const value_type &right) { return std::max(left, right); }
+
+        static value_type lift(const T &value) { return value; }
+    };
+
+    //hash of the values of a subtree in order, a polynomial hash modulo 2^61 - 1.
+    //it depends only on the sequence of values and not on the shape of the tree,
+    //so trees with equal hashes hold the same values with probability about 1 - n / 2^61
+    template<class T, class THash = std::hash<T>>
+    struct MerkleHash{
+        struct value_type{
+            uint64_t hash;
+
+            //base to the power of the number of values
+            uint64_t power;
+
+            bool operator==(const value_type &other) const { return hash == other.hash && power == other.power; }
+
+            bool operator!=(const value_type &other) const { return !(*this == other); }
+        };
+
+        static const uint64_t modulus = (uint64_t(1) << 61) - 1;
+
+        static const uint64_t base = 0x1f3d5b79a2c4e68bULL % modulus;
+
+        static uint64_t multiply(uint64_t first, uint64_t second){
+#ifdef __SIZEOF_INT128__
+            unsigned __int128 product = static_cast<unsigned __int128>(first) * second;
+            uint64_t result = (static_cast<uint64_t>(product) & modulus) + static_cast<uint64_t>(product >> 61);
+            result = (result & modulus) + (result >> 61);
+#else
+            uint64_t result = 0;
+            for (; second; second >>= 1){
+                if (second & 1){
+                    result = (result + first) % modulus;
+                }
+                first = (first << 1) % modulus;
+            }
+#endif
+            return result >= modulus ? result - modulus : result;
+        }
+
+        //spreads the bits of THash, which is the identity for integers in common libraries
+        static uint64_t mix(uint64_t hash){
+            hash += 0x9e3779b97f4a7c15ULL;
+            hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+            return (hash ^ (hash >> 31)) % modulus;
+        }
+
+        static value_type identity() { return value_type{0, 1}; }
+
+        static value_type combine(const value_type &left, const value_type &right){
+            uint64_t hash = multiply(left.hash, right.power) + right.hash;
+            return value_type{hash >= modulus ? hash - modulus : hash, multiply(left.power, right.power)};
+        }
+
+        static value_type lift(const T &value) { return value_type{mix(THash()(value)), base}; }
+    };
+
+    //storage of the subtree aggregate, a base of the tree node
+    template<class TAggregate, class T>
+    struct SubtreeAggregate{
+        typename TAggregate::value_type aggregate = TAggregate::identity();
+
+        //values are combined in order: left subtree, the node, right subtree
+        void updateAggregate(const T &value, const SubtreeAggregate *left, const SubtreeAggregate *right){
+            aggregate = TAggregate::lift(value);
+            if (left){
+                aggregate = TAggregate::combine(left->aggregate, aggregate);
+            }
+            if (right){
+                aggregate = TAggregate::combine(aggregate, right->aggregate);
+            }
+        }
+    };
+
+    //empty, so nodes without an aggregate keep their size
+    template<class T>
+    struct SubtreeAggregate<NoAggregate, T>{
+        void updateAggregate(const T &, const SubtreeAggregate *, const SubtreeAggregate *){}
+    };
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <type_traits>
+#include <stdexcept>
+#include <cstddef>
+
+namespace avl{
+    //immutable sorted set for read-mostly lookups, produced by AVLTree::freeze.
+    //values are kept in one sorted array cut into blocks of block_size,
+    //the last value of every block is copied into a small index in Eytzinger order
+    //(children of slot k are 2k and 2k + 1), so a lookup walks the index
+    //without branches on the comparison and finishes with a scan of one block
+    template<class T, class TCompare = std::less<T>>
+    class FrozenSet{
+    private:
+        static const size_t block_size = 16;
+
+        std::vector<T> values;
+
+        //1-based, slot 0 is padding
+        std::vector<T> index;
+
+        //block whose last value is stored in the index slot
+        std::vector<size_t> index_blocks;
+
+        TCompare cmp;
+
+        size_t buildIndex(size_t slot, size_t block){
+            if (slot >= index.size()){
+                return block;
+            }
+            block = buildIndex(2 * slot, block);
+            index[slot] = values[std::min(values.size(), (block + 1) * block_size) - 1];
+            index_blocks[slot] = block;
+            return buildIndex(2 * slot + 1, block + 1);
+        }
+
+        //arithmetic values are counted without branches, the loop is short enough to vectorize
+        template<class Before>
+        size_t countBefore(const T *first, const T *last, Before before, std::true_type) const {
+            size_t count = 0;
+            for (; first != last; ++first){
+                count += before(*first);
+            }
+            return count;
+        }
+
+        template<class Before>
+        size_t countBefore(const T *first, const T *last, Before before, std::false_type) const {
+            return std::partition_point(first, last, before) - first;
+        }
+
+        //number of values for which before holds, before must be monotone over the sorted values
+        template<class Before>
+        size_t partitionPoint(Before before) const {
+            size_t slot = 1;
+            while (slot < index.size()){
+                slot = 2 * slot + before(index[slot]);
+            }
+            //drop the trailing right turns and the last left turn, 0 means every block is before
+            while (slot & 1){
+                slot >>= 1;
+            }
+            slot >>= 1;
+            if (!slot){
+                return values.size();
+            }
+
+            size_t first = index_blocks[slot] * block_size;
+            size_t last = std::min(values.size(), first + block_size);
+            return first + countBefore(values.data() + first, values.data() + last, before,
+                                       std::is_arithmetic<T>());
+        }
+
+    public:
+        using const_iterator = const T *;
+
+        explicit FrozenSet(const TCompare &cmp = TCompare())
+                :cmp(cmp){}
+
+        //values must be sorted by cmp and unique
+        explicit FrozenSet(std::vector<T> values, const TCompare &cmp = TCompare())
+                :values(std::move(values))
+                ,cmp(cmp){
+            if (this->values.empty()){
+                return;
+            }
+            size_t blocks = (this->values.size() + block_size - 1) / block_size;
+            index.assign(blocks + 1, this->values.front());
+            index_blocks.assign(blocks + 1, 0);
+            buildIndex(1, 0);
+        }
+
+        size_t size() const noexcept { return values.size(); }
+
+        bool empty() const noexcept { return values.empty(); }
+
+        //in-order scans, begin() + rank(value) is the first value not less than value
+        const_iterator begin() const noexcept { return values.data(); }
+
+        const_iterator end() const noexcept { return values.data() + values.size(); }
+
+        bool contains(const T &value) const {
+            size_t position = rank(value);
+            return position < values.size() && !cmp(value, values[position]);
+        }
+
+        //number of values less than value
+        size_t rank(const T &value) const {
+            return partitionPoint([this, &value](const T &other){ return cmp(other, value); });
+        }
+
+        //k-th smallest value, 0-based, throws std::out_of_range
+        const T &select(size_t k) const { return values.at(k); }
+
+        //number of values in [lo, hi]
+        size_t countInRange(const T &lo, const T &hi) const {
+            if (cmp(hi, lo)){
+                return 0;
+            }
+            return partitionPoint([this, &hi](const T &other){ return !cmp(hi, other); }) - rank(lo);
+        }
+
+        //first value not less than value, nullptr if there is none
+        const T *lowerBound(const T &value) const {
+            size_t position = rank(value);
+            return position < values.size() ? &values[position] : nullptr;
+        }
+
+        //first value greater than value, nullptr if there is none
+        const T *upperBound(const T &value) const {
+            size_t position = partitionPoint([this, &value](const T &other){ return !cmp(value, other); });
+            return position < values.size() ? &values[position] : nullptr;
+        }
+
+        const std::vector<T> &toArray() const noexcept { return values; }
+    };
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "NodePool.h"
+
+namespace avl{
+    //layout policies choose how tree nodes store their links and bookkeeping:
+    //link<TNode> is the type of a child link, NodeBase is a base of the node,
+    //pool<TNode> allocates the nodes, height_type and size_type hold the subtree height and size,
+    //version_type holds the snapshot version that stamps the node
+
+    //child link stored as a 32-bit handle of an indexed NodePool, it converts to and from TNode *
+    template<class TNode>
+    class IndexedLink{
+    private:
+        uint32_t handle = 0;
+
+    public:
+        IndexedLink(TNode *node = nullptr) noexcept : handle(node ? node->handle : 0) {}
+
+        IndexedLink &operator=(TNode *node) noexcept {
+            handle = node ? node->handle : 0;
+            return *this;
+        }
+
+        operator TNode *() const noexcept {
+            if (!handle){
+                return nullptr;
+            }
+            auto slab = reinterpret_cast<TNode *>(SlabTable::base(handle >> SlabTable::offset_bits));
+            return slab + (handle & (SlabTable::slab_capacity - 1));
+        }
+
+        TNode *operator->() const noexcept { return *this; }
+    };
+
+    //plain pointers, the default
+    struct PointerLayout{
+        template<class TNode>
+        using link = TNode *;
+
+        struct NodeBase{};
+
+        template<class TNode>
+        using pool = NodePool<TNode>;
+
+        using height_type = unsigned int;
+
+        using size_type = size_t;
+
+        using version_type = uint64_t;
+    };
+
+    //nodes about 70% the size of PointerLayout ones for small keys, 28 bytes instead of 40 for int values:
+    //32-bit child handles, a one byte height, 32-bit subtree sizes and versions. a tree holds at most 2^32 - 1 values,
+    //at most 2^32 - 1 snapshots are taken by the whole program, and following a link costs one more load from the slab table
+    struct CompactLayout{
+        template<class TNode>
+        using link = IndexedLink<TNode>;
+
+        struct NodeBase{
+            //own handle, kept up to date by the pool
+            uint32_t handle;
+        };
+
+        template<class TNode>
+        using pool = NodePool<TNode, true>;
+
+        using height_type = uint8_t;
+
+        using size_type = uint32_t;
+
+        using version_type = uint32_t;
+    };
+}
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <utility>
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+
+namespace avl{
+    //process-wide table of the slabs of indexed pools, so nodes can be named by a 32-bit handle:
+    //the slab number in the high bits and the offset in the slab in the low ones, 0 is null
+    class SlabTable{
+    public:
+        static const uint32_t offset_bits = 12;
+
+        static const size_t slab_capacity = size_t(1) << offset_bits;
+
+        static const size_t max_slabs = size_t(1) << (32 - offset_bits);
+
+        static uint32_t add(void *slab){
+            std::lock_guard<std::mutex> lock(mutex());
+            auto &state = freeIds();
+            uint32_t id;
+            if (!state.empty()){
+                id = state.back();
+                state.pop_back();
+            }
+            else if (nextId() < max_slabs){
+                id = nextId()++;
+            }
+            else{
+                throw std::length_error("SlabTable is out of slab numbers");
+            }
+            entry(id) = static_cast<char *>(slab);
+            return id;
+        }
+
+        static void remove(uint32_t id){
+            std::lock_guard<std::mutex> lock(mutex());
+            entry(id) = nullptr;
+            freeIds().push_back(id);
+        }
+
+        //entries are written before any handle into the slab is given out
+        static char *base(uint32_t id) noexcept { return chunks()[id >> chunk_bits][id & (chunk_size - 1)]; }
+
+    private:
+        static const uint32_t chunk_bits = 10;
+
+        static const size_t chunk_size = size_t(1) << chunk_bits;
+
+        //the table is split into chunks of chunk_size entries, allocated when the first slab number
+        //of a chunk is given out, so only the max_slabs / chunk_size chunk pointers are static.
+        //chunks are kept to the end of the program, pools destroyed at exit may still remove their slabs
+        static char ***chunks(){
+            static char **table[max_slabs / chunk_size];
+            return table;
+        }
+
+        //called with the mutex held
+        static char *&entry(uint32_t id){
+            auto &chunk = chunks()[id >> chunk_bits];
+            if (!chunk){
+                chunk = new char *[chunk_size]();
+            }
+            return chunk[id & (chunk_size - 1)];
+        }
+
+        static std::mutex &mutex(){
+            static std::mutex table_mutex;
+            return table_mutex;
+        }
+
+        static std::vector<uint32_t> &freeIds(){
+            static std::vector<uint32_t> ids;
+            return ids;
+        }
+
+        //slab 0 is never used, so handle 0 stays null
+        static size_t &nextId(){
+            static size_t id = 1;
+            return id;
+        }
+    };
+
+    //slab allocator for tree nodes: nodes are carved from contiguous slabs,
+    //freed nodes are recycled through an intrusive free list,
+    //the whole pool is released at once without visiting nodes.
+    //TNode is expected to link its children through left_child and right_child.
+    //an indexed pool registers its slabs in SlabTable and stores the handle of every node in node->handle
+    template<class TNode, bool indexed = false>
+    class NodePool{
+    private:
+        using Slot = typename std::aligned_storage<sizeof(TNode), alignof(TNode)>::type;
+
+        struct FreeSlot{
+            FreeSlot *next;
+
+            uint32_t handle;
+        };
+
+        static_assert(sizeof(TNode) >= sizeof(FreeSlot), "node is too small to be linked into the free list");
+
+        static const size_t min_slab_size = 64;
+
+        static const size_t max_slab_size = indexed ? SlabTable::slab_capacity : 1 << 16;
+
+        std::vector<std::unique_ptr<Slot[]>> slabs;
+
+        //numbers of the slabs in SlabTable, only for indexed pools
+        std::vector<uint32_t> slab_ids;
+
+        uint32_t next_handle = 0;
+
+        Slot *next_slot = nullptr;
+
+        Slot *slab_end = nullptr;
+
+        size_t next_slab_size = min_slab_size;
+
+        FreeSlot *free_list = nullptr;
+
+        //roots of dropped subtrees, destroyed node by node as their slots are reused
+        std::vector<TNode *> deferred;
+
+        size_t live_nodes = 0;
+
+        size_t capacity = 0;
+
+        static uint32_t handleOf(const TNode *, std::false_type) { return 0; }
+
+        static uint32_t handleOf(const TNode *node, std::true_type) { return node->handle; }
+
+        static void setHandle(TNode *, uint32_t, std::false_type) {}
+
+        static void setHandle(TNode *node, uint32_t handle, std::true_type) { node->handle = handle; }
+
+        void addSlab(){
+            slabs.emplace_back(new Slot[next_slab_size]);
+            next_slot = slabs.back().get();
+            slab_end = next_slot + next_slab_size;
+            capacity += next_slab_size;
+            if (indexed){
+                slab_ids.push_back(SlabTable::add(next_slot));
+                next_handle = slab_ids.back() << SlabTable::offset_bits;
+            }
+            if (next_slab_size < max_slab_size){
+                next_slab_size *= 2;
+            }
+        }
+
+        //returns the slot and its handle
+        std::pair<void *, uint32_t> allocate(){
+            if (free_list){
+                auto slot = free_list;
+                free_list = free_list->next;
+                return std::make_pair(static_cast<void *>(slot), slot->handle);
+            }
+
+            if (!deferred.empty()){
+                auto node = deferred.back();
+                deferred.pop_back();
+                pushChildren(node);
+                uint32_t handle = handleOf(node, std::integral_constant<bool, indexed>());
+                node->~TNode();
+                --live_nodes;
+                return std::make_pair(static_cast<void *>(node), handle);
+            }
+
+            if (next_slot == slab_end){
+                addSlab();
+            }
+            return std::make_pair(static_cast<void *>(next_slot++), next_handle++);
+        }
+
+        void pushChildren(const TNode *node){
+            if (node->left_child){
+                deferred.push_back(node->left_child);
+            }
+            if (node->right_child){
+                deferred.push_back(node->right_child);
+            }
+        }
+
+    public:
+        NodePool() = default;
+
+        ~NodePool(){
+            //trivial nodes need no walk, but their slab numbers still go back to the table
+            while (!std::is_trivially_destructible<TNode>::value && !deferred.empty()){
+                auto node = deferred.back();
+                deferred.pop_back();
+                pushChildren(node);
+                node->~TNode();
+            }
+            for (auto id : slab_ids){
+                SlabTable::remove(id);
+            }
+        }
+
+        NodePool(const NodePool &other) = delete;
+
+        NodePool &operator=(const NodePool &other) = delete;
+
+        template<class... Args>
+        TNode *create(Args&&... args){
+            auto slot = allocate();
+            auto node = new (slot.first) TNode(std::forward<Args>(args)...);
+            setHandle(node, slot.second, std::integral_constant<bool, indexed>());
+            ++live_nodes;
+            return node;
+        }
+
+        void destroy(TNode *node){
+            uint32_t handle = handleOf(node, std::integral_constant<bool, indexed>());
+            node->~TNode();
+            auto *slot = reinterpret_cast<FreeSlot *>(node);
+            slot->next = free_list;
+            slot->handle = handle;
+            free_list = slot;
+            --live_nodes;
+        }
+
+        //drops a whole subtree in O(1), its nodes are destroyed when their slots are reused
+        void destroyLater(TNode *subtree_root){
+            if (subtree_root){
+                deferred.push_back(subtree_root);
+            }
+        }
+
+        //takes over the slabs of other, nodes allocated by other stay valid
+        void adopt(NodePool &&other){
+            for (auto &slab : other.slabs){
+                slabs.push_back(std::move(slab));
+            }
+            slab_ids.insert(slab_ids.end(), other.slab_ids.begin(), other.slab_ids.end());
+            other.slab_ids.clear();
+            deferred.insert(deferred.end(), other.deferred.begin(), other.deferred.end());
+            other.deferred.clear();
+            live_nodes += other.live_nodes;
+            capacity += other.capacity;
+            //free slots and the unused tail of other's current slab are not reused
+            other.slabs.clear();
+            other.next_slot = other.slab_end = nullptr;
+            other.free_list = nullptr;
+            other.live_nodes = other.capacity = 0;
+            other.next_slab_size = min_slab_size;
+        }
+
+        size_t size() const noexcept { return live_nodes; }
+
+        size_t bytes() const noexcept { return capacity * sizeof(Slot); }
+    };
+}
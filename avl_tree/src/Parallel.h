@@ -0,0 +1,51 @@
+#pragma once
+
+#include <algorithm>
+#include <future>
+#include <thread>
+#include <utility>
+
+namespace avl{
+    //subproblems smaller than this are not worth a thread
+    const size_t parallel_grain = 1 << 14;
+
+    //number of fork levels that keeps every hardware thread busy
+    inline unsigned parallelDepth(){
+        unsigned threads = std::thread::hardware_concurrency();
+        unsigned depth = 0;
+        while ((1u << depth) < threads){
+            ++depth;
+        }
+        return depth + 1;
+    }
+
+    //runs both tasks, the first one on its own thread if parallel is set
+    template<class TFirst, class TSecond>
+    void forkJoin(bool parallel, TFirst &&first, TSecond &&second){
+        if (!parallel){
+            first();
+            second();
+            return;
+        }
+
+        auto forked = std::async(std::launch::async, std::forward<TFirst>(first));
+        second();
+        forked.get();
+    }
+
+    //merge sort whose halves are sorted on their own threads for the top depth levels
+    template<class Iterator, class TCompare>
+    void parallelSort(Iterator first, Iterator last, const TCompare &cmp, unsigned depth){
+        auto count = last - first;
+        if (depth == 0 || size_t(count) < 2 * parallel_grain){
+            std::sort(first, last, cmp);
+            return;
+        }
+
+        auto middle = first + count / 2;
+        forkJoin(true,
+                 [&](){ parallelSort(first, middle, cmp, depth - 1); },
+                 [&](){ parallelSort(middle, last, cmp, depth - 1); });
+        std::inplace_merge(first, middle, last, cmp);
+    }
+}
@@ -0,0 +1,227 @@
+#include "ShardedSet.h"
+
+using namespace std;
+using namespace avl;
+
+template<typename T, typename TCompare>
+const size_t ShardedSet<T, TCompare>::min_shard_size;
+
+template<typename T, typename TCompare>
+ShardedSet<T, TCompare>::ShardedSet(size_t target_shard_count, const TCompare &cmp)
+        :cmp(cmp)
+        ,target_shard_count(std::max<size_t>(target_shard_count, 1))
+        ,split_above(2 * min_shard_size){
+    shards.emplace_back(new Shard(AVLTree<T, TCompare>(cmp)));
+}
+
+template<typename T, typename TCompare>
+ShardedSet<T, TCompare>::ShardedSet(const vector<T> &elements, size_t target_shard_count, const TCompare &cmp)
+        :cmp(cmp)
+        ,target_shard_count(std::max<size_t>(target_shard_count, 1))
+        ,split_above(2 * min_shard_size){
+    vector<T> sorted(elements);
+    std::sort(sorted.begin(), sorted.end(), cmp);
+    sorted.erase(std::unique(sorted.begin(), sorted.end(), [&cmp](const T &first, const T &second){
+        return !cmp(first, second);
+    }), sorted.end());
+
+    //shards are built directly from consecutive slices
+    size_t average = std::max(min_shard_size, sorted.size() / this->target_shard_count + 1);
+    for (size_t first = 0; first < sorted.size() || shards.empty(); first += average){
+        size_t last = std::min(sorted.size(), first + average);
+        vector<T> slice(sorted.begin() + first, sorted.begin() + last);
+        if (first > 0){
+            boundaries.push_back(slice.front());
+        }
+        shards.emplace_back(new Shard(AVLTree<T, TCompare>(sortedUnique, slice, cmp)));
+    }
+    split_above = 2 * average;
+}
+
+template<typename T, typename TCompare>
+size_t ShardedSet<T, TCompare>::shardIndex(const T &value) const {
+    return std::upper_bound(boundaries.begin(), boundaries.end(), value, cmp) - boundaries.begin();
+}
+
+template<typename T, typename TCompare>
+vector<typename ShardedSet<T, TCompare>::SharedLock> ShardedSet<T, TCompare>::lockShards(size_t first, size_t last) const {
+    vector<SharedLock> locks;
+    locks.reserve(last - first + 1);
+    for (size_t i = first; i <= last; ++i){
+        locks.emplace_back(shards[i]->mutex);
+    }
+    return locks;
+}
+
+template<typename T, typename TCompare>
+size_t ShardedSet<T, TCompare>::size() const {
+    SharedLock layout(layout_mutex);
+    auto locks = lockShards(0, shards.size() - 1);
+    size_t total = 0;
+    for (auto &shard : shards){
+        total += shard->tree.size();
+    }
+    return total;
+}
+
+template<typename T, typename TCompare>
+size_t ShardedSet<T, TCompare>::shardCount() const {
+    SharedLock layout(layout_mutex);
+    return shards.size();
+}
+
+template<typename T, typename TCompare>
+bool ShardedSet<T, TCompare>::insert(const T &value) {
+    bool inserted;
+    size_t shard_size;
+    {
+        SharedLock layout(layout_mutex);
+        auto &shard = *shards[shardIndex(value)];
+        UniqueLock lock(shard.mutex);
+        inserted = shard.tree.insert(value);
+        shard_size = shard.tree.size();
+    }
+
+    if (shard_size > split_above.load(std::memory_order_relaxed)){
+        rebalance();
+    }
+    return inserted;
+}
+
+template<typename T, typename TCompare>
+bool ShardedSet<T, TCompare>::deleteIfExists(const T &value) {
+    SharedLock layout(layout_mutex);
+    auto &shard = *shards[shardIndex(value)];
+    UniqueLock lock(shard.mutex);
+    return shard.tree.deleteIfExists(value);
+}
+
+template<typename T, typename TCompare>
+bool ShardedSet<T, TCompare>::contains(const T &value) const {
+    SharedLock layout(layout_mutex);
+    auto &shard = *shards[shardIndex(value)];
+    SharedLock lock(shard.mutex);
+    return shard.tree.contains(value);
+}
+
+template<typename T, typename TCompare>
+T ShardedSet<T, TCompare>::select(size_t k) const {
+    SharedLock layout(layout_mutex);
+    auto locks = lockShards(0, shards.size() - 1);
+    for (auto &shard : shards){
+        if (k < shard->tree.size()){
+            return shard->tree.select(k);
+        }
+        k -= shard->tree.size();
+    }
+    throw std::out_of_range("ShardedSet::select index is out of range");
+}
+
+template<typename T, typename TCompare>
+size_t ShardedSet<T, TCompare>::rank(const T &value) const {
+    SharedLock layout(layout_mutex);
+    size_t index = shardIndex(value);
+    auto locks = lockShards(0, index);
+    size_t less = shards[index]->tree.rank(value);
+    for (size_t i = 0; i < index; ++i){
+        less += shards[i]->tree.size();
+    }
+    return less;
+}
+
+template<typename T, typename TCompare>
+size_t ShardedSet<T, TCompare>::countInRange(const T &lo, const T &hi) const {
+    if (cmp(hi, lo)){
+        return 0;
+    }
+
+    SharedLock layout(layout_mutex);
+    size_t first = shardIndex(lo);
+    size_t last = shardIndex(hi);
+    auto locks = lockShards(first, last);
+    size_t count = 0;
+    for (size_t i = first; i <= last; ++i){
+        count += shards[i]->tree.countInRange(lo, hi);
+    }
+    return count;
+}
+
+template<typename T, typename TCompare>
+template<class F>
+void ShardedSet<T, TCompare>::forEachInRange(const T &lo, const T &hi, F f) const {
+    if (cmp(hi, lo)){
+        return;
+    }
+
+    SharedLock layout(layout_mutex);
+    size_t first = shardIndex(lo);
+    size_t last = shardIndex(hi);
+    auto locks = lockShards(first, last);
+    for (size_t i = first; i <= last; ++i){
+        shards[i]->tree.forEachInRange(lo, hi, std::ref(f));
+    }
+}
+
+template<typename T, typename TCompare>
+vector<T> ShardedSet<T, TCompare>::toArray() const {
+    SharedLock layout(layout_mutex);
+    auto locks = lockShards(0, shards.size() - 1);
+    vector<T> array;
+    for (auto &shard : shards){
+        for (auto &value : shard->tree){
+            array.push_back(value);
+        }
+    }
+    return array;
+}
+
+//the upper half moves into a new shard with a pool of its own, shards never share a pool
+//because they are changed concurrently
+template<typename T, typename TCompare>
+void ShardedSet<T, TCompare>::splitShard(size_t index) {
+    auto &tree = shards[index]->tree;
+    T median = tree.select(tree.size() / 2);
+    auto halves = AVLTree<T, TCompare>::split(tree, median, true);
+    tree = std::move(halves.first);
+    std::unique_ptr<Shard> upper(new Shard(AVLTree<T, TCompare>(halves.second)));
+    halves.second.clear();
+
+    shards.insert(shards.begin() + index + 1, std::move(upper));
+    boundaries.insert(boundaries.begin() + index, std::move(median));
+}
+
+//the ranges are disjoint, so the union is a join and the pool of the upper shard is adopted
+template<typename T, typename TCompare>
+void ShardedSet<T, TCompare>::mergeShards(size_t index) {
+    shards[index]->tree.uniteWith(std::move(shards[index + 1]->tree));
+    shards.erase(shards.begin() + index + 1);
+    boundaries.erase(boundaries.begin() + index);
+}
+
+template<typename T, typename TCompare>
+void ShardedSet<T, TCompare>::rebalance() {
+    UniqueLock layout(layout_mutex);
+    size_t total = 0;
+    for (auto &shard : shards){
+        total += shard->tree.size();
+    }
+    size_t average = std::max(min_shard_size, total / target_shard_count + 1);
+
+    for (size_t i = 0; i < shards.size();){
+        if (shards[i]->tree.size() > 2 * average){
+            splitShard(i);
+        }
+        else{
+            ++i;
+        }
+    }
+    for (size_t i = 0; i + 1 < shards.size();){
+        if (shards[i]->tree.size() + shards[i + 1]->tree.size() <= average){
+            mergeShards(i);
+        }
+        else{
+            ++i;
+        }
+    }
+    split_above.store(2 * average, std::memory_order_relaxed);
+}
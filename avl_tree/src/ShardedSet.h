@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <shared_mutex>
+
+#include "AVLTree.h"
+
+namespace avl{
+    //ordered set for concurrent use: the key space is cut into ranges, each kept in its own AVLTree
+    //behind its own reader-writer lock, so updates of different ranges do not wait for each other.
+    //cross-shard queries lock the shards they read in key order and see a consistent state.
+    //shards that grow past twice the average are split at their median, small neighbours are merged
+    template<class T, class TCompare = std::less<T>>
+    class ShardedSet {
+    private:
+        struct Shard{
+            mutable std::shared_timed_mutex mutex;
+
+            AVLTree<T, TCompare> tree;
+
+            explicit Shard(AVLTree<T, TCompare> &&tree) : tree(std::move(tree)) {}
+        };
+
+        using SharedLock = std::shared_lock<std::shared_timed_mutex>;
+
+        using UniqueLock = std::unique_lock<std::shared_timed_mutex>;
+
+        //shards below this size are never split
+        static const size_t min_shard_size = 1 << 10;
+
+        //held shared by every operation, exclusively only while shard boundaries move
+        mutable std::shared_timed_mutex layout_mutex;
+
+        std::vector<std::unique_ptr<Shard>> shards;
+
+        //boundaries[i] is the smallest value that belongs to shards[i + 1]
+        std::vector<T> boundaries;
+
+        TCompare cmp;
+
+        size_t target_shard_count;
+
+        //inserts into a shard larger than this trigger rebalancing
+        std::atomic<size_t> split_above;
+
+        size_t shardIndex(const T &value) const;
+
+        void splitShard(size_t index);
+
+        void mergeShards(size_t index);
+
+        //shared locks on shards[first..last] in key order
+        std::vector<SharedLock> lockShards(size_t first, size_t last) const;
+
+    public:
+        explicit ShardedSet(size_t target_shard_count = std::thread::hardware_concurrency(),
+                            const TCompare &cmp = TCompare());
+
+        ShardedSet(const std::vector<T> &elements, size_t target_shard_count = std::thread::hardware_concurrency(),
+                   const TCompare &cmp = TCompare());
+
+        ShardedSet(const ShardedSet &other) = delete;
+
+        ShardedSet &operator=(const ShardedSet &other) = delete;
+
+        size_t size() const;
+
+        size_t shardCount() const;
+
+        bool insert(const T &value);
+
+        bool deleteIfExists(const T &value);
+
+        bool contains(const T &value) const;
+
+        //order statistics across the shards, select throws std::out_of_range
+        T select(size_t k) const;
+
+        size_t rank(const T &value) const;
+
+        size_t countInRange(const T &lo, const T &hi) const;
+
+        //calls f for every value in [lo, hi] in order while the shards in the range are read-locked
+        template<class F>
+        void forEachInRange(const T &lo, const T &hi, F f) const;
+
+        std::vector<T> toArray() const;
+
+        //splits oversized shards and merges small neighbours, runs by itself when a shard outgrows the others
+        void rebalance();
+    };
+}
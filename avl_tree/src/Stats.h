@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace avl{
+    //statistics policies receive events from the hot paths of a tree:
+    //countComparisons(count) from searches, countRotation(is_double) from rebalancing,
+    //recordSearchDepth(depth) once per search and recordMergeDepth(depth) once per join of two subtrees
+
+    //the default policy, the calls are empty and compile away
+    struct NoStats{
+        void countComparisons(size_t) {}
+
+        void countRotation(bool) {}
+
+        void recordSearchDepth(size_t) {}
+
+        void recordMergeDepth(size_t) {}
+    };
+
+    //counters of a tree. relaxed atomics, so concurrent readers and the parallel set operations may update them
+    class TreeStats{
+    public:
+        //depths from this on share the last bucket of a histogram
+        static const size_t histogram_size = 64;
+
+        TreeStats() { reset(); }
+
+        TreeStats(const TreeStats &other) = delete;
+
+        TreeStats &operator=(const TreeStats &other) = delete;
+
+        void countComparisons(size_t count) { comparisons.fetch_add(count, std::memory_order_relaxed); }
+
+        void countRotation(bool is_double){
+            (is_double ? double_rotations : single_rotations).fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void recordSearchDepth(size_t depth) { search_depths[bucket(depth)].fetch_add(1, std::memory_order_relaxed); }
+
+        void recordMergeDepth(size_t depth) { merge_depths[bucket(depth)].fetch_add(1, std::memory_order_relaxed); }
+
+        uint64_t comparisonCount() const { return comparisons.load(std::memory_order_relaxed); }
+
+        uint64_t singleRotationCount() const { return single_rotations.load(std::memory_order_relaxed); }
+
+        uint64_t doubleRotationCount() const { return double_rotations.load(std::memory_order_relaxed); }
+
+        //number of searches that went depth nodes deep
+        uint64_t searchesAtDepth(size_t depth) const { return search_depths[bucket(depth)].load(std::memory_order_relaxed); }
+
+        //number of joins whose recursion went depth levels deep
+        uint64_t mergesAtDepth(size_t depth) const { return merge_depths[bucket(depth)].load(std::memory_order_relaxed); }
+
+        void reset(){
+            comparisons.store(0, std::memory_order_relaxed);
+            single_rotations.store(0, std::memory_order_relaxed);
+            double_rotations.store(0, std::memory_order_relaxed);
+            for (size_t i = 0; i < histogram_size; ++i){
+                search_depths[i].store(0, std::memory_order_relaxed);
+                merge_depths[i].store(0, std::memory_order_relaxed);
+            }
+        }
+
+    private:
+        static size_t bucket(size_t depth) { return depth < histogram_size ? depth : histogram_size - 1; }
+
+        std::atomic<uint64_t> comparisons;
+
+        std::atomic<uint64_t> single_rotations;
+
+        std::atomic<uint64_t> double_rotations;
+
+        std::atomic<uint64_t> search_depths[histogram_size];
+
+        std::atomic<uint64_t> merge_depths[histogram_size];
+    };
+}
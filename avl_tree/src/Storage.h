@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define AVL_HAS_MMAP 1
+#endif
+
+namespace avl{
+    //header of the binary tree format, followed by size values in order, native byte order
+    struct FileHeader{
+        static const uint32_t expected_magic = 0x544c5641; //"AVLT"
+
+        static const uint32_t current_format = 1;
+
+        uint32_t magic;
+
+        uint32_t format;
+
+        uint32_t value_size;
+
+        uint32_t height;
+
+        uint64_t size;
+
+        //keeps the values behind the header aligned
+        uint64_t reserved;
+    };
+
+    //throws std::runtime_error if the header does not describe values of value_size bytes
+    inline void checkHeader(const FileHeader &header, size_t value_size){
+        if (header.magic != FileHeader::expected_magic){
+            throw std::runtime_error("not an AVLTree file or different byte order");
+        }
+        if (header.format != FileHeader::current_format){
+            throw std::runtime_error("unsupported AVLTree file format");
+        }
+        if (header.value_size != value_size){
+            throw std::runtime_error("AVLTree file holds values of another type");
+        }
+        if (header.size > SIZE_MAX / value_size){
+            throw std::runtime_error("AVLTree file size is out of range");
+        }
+    }
+
+    //read-only view of a whole file, mapped into memory where the platform allows it
+    class MappedFile{
+    private:
+        const char *bytes = nullptr;
+
+        size_t length = 0;
+
+#ifndef AVL_HAS_MMAP
+        std::vector<char> buffer;
+#endif
+
+    public:
+        explicit MappedFile(const std::string &path){
+#ifdef AVL_HAS_MMAP
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0){
+                throw std::runtime_error("cannot open " + path + ": " + std::strerror(errno));
+            }
+            struct stat info;
+            if (::fstat(fd, &info) != 0){
+                ::close(fd);
+                throw std::runtime_error("cannot stat " + path + ": " + std::strerror(errno));
+            }
+            length = static_cast<size_t>(info.st_size);
+            if (length > 0){
+                void *mapped = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapped == MAP_FAILED){
+                    ::close(fd);
+                    throw std::runtime_error("cannot map " + path + ": " + std::strerror(errno));
+                }
+                ::madvise(mapped, length, MADV_SEQUENTIAL);
+                bytes = static_cast<const char *>(mapped);
+            }
+            ::close(fd);
+#else
+            std::ifstream file(path, std::ios::binary);
+            if (!file){
+                throw std::runtime_error("cannot open " + path);
+            }
+            buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            bytes = buffer.data();
+            length = buffer.size();
+#endif
+        }
+
+        ~MappedFile(){
+#ifdef AVL_HAS_MMAP
+            if (bytes){
+                ::munmap(const_cast<char *>(bytes), length);
+            }
+#endif
+        }
+
+        MappedFile(const MappedFile &other) = delete;
+
+        MappedFile &operator=(const MappedFile &other) = delete;
+
+        const char *data() const noexcept { return bytes; }
+
+        size_t size() const noexcept { return length; }
+    };
+}
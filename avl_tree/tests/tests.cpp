@@ -1,11 +1,31 @@
 #include "gtest/gtest.h"
 #include "AVLTree.h"
 #include "AVLTree.cpp"
+#include "AVLMap.h"
+#include "AVLMap.cpp"
+#include "AVLSequence.h"
+#include "AVLSequence.cpp"
+#include "ShardedSet.h"
+#include "ShardedSet.cpp"
 #include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <thread>
+#include <sstream>
+#include <fstream>
+#include <map>
+#include <cstring>
+#include <cstddef>
+#include <limits>
 
 using namespace std;
 using namespace avl;
 
+template<typename T, typename TCompare>
+bool hasAVLHeight(const AVLTree<T, TCompare> &tree){
+    return tree.height() <= 1.45 * log2(tree.size() + 2);
+}
+
 TEST(TreeOperations, InsertAndDelete){
     AVLTree<int> tree;
     set<int> set;
@@ -46,6 +66,207 @@ TEST(TreeOperations, ToArray){
     ASSERT_EQ(vector, vector_copy);
 }
 
+TEST(TreeOperations, StatisticsPolicy){
+    AVLTree<int, less<int>, NoAggregate, PointerLayout, TreeStats> tree;
+    for (int i = 0; i < 1000; ++i){
+        tree.insert(i);
+    }
+    auto &stats = tree.statistics();
+    ASSERT_GT(stats.singleRotationCount(), 0);
+    ASSERT_EQ(0, stats.doubleRotationCount()); //ascending inserts never need a double rotation
+    ASSERT_EQ(1000, tree.allocatedNodes());
+    ASSERT_GE(tree.allocatedBytes(), 1000 * sizeof(int));
+
+    stats.reset();
+    for (int i = 0; i < 100; ++i){
+        ASSERT_TRUE(tree.contains(i * 10));
+    }
+    ASSERT_FALSE(tree.contains(-1));
+    uint64_t searches = 0;
+    for (size_t depth = 0; depth < TreeStats::histogram_size; ++depth){
+        searches += stats.searchesAtDepth(depth);
+    }
+    ASSERT_EQ(101, searches);
+    ASSERT_EQ(0, stats.searchesAtDepth(tree.height() + 1));
+    ASSERT_LE(stats.comparisonCount(), 101 * 2 * tree.height());
+
+    auto halves = decltype(tree)::split(tree, 500, false);
+    uint64_t merges = 0;
+    for (size_t depth = 0; depth < TreeStats::histogram_size; ++depth){
+        merges += stats.mergesAtDepth(depth);
+    }
+    ASSERT_GT(merges, 0);
+    ASSERT_EQ(0, halves.first.statistics().comparisonCount());
+}
+
+TEST(TreeOperations, ParallelBuildFromUnsortedVector){
+    vector<string> keys;
+    for (int i = 0; i < 200000; ++i){
+        keys.push_back(to_string(random() % 150000));
+    }
+    set<string> expected(keys.begin(), keys.end());
+    AVLTree<string> tree(keys);
+    ASSERT_TRUE(tree == expected);
+    ASSERT_TRUE(hasAVLHeight(tree));
+
+    AVLTree<string, less<string>, NoAggregate, CompactLayout> compact(std::move(keys));
+    ASSERT_TRUE(equal(expected.begin(), expected.end(), compact.begin(), compact.end()));
+    compact.insert("x");
+    compact.deleteIfExists(*expected.begin());
+    ASSERT_EQ(expected.size(), compact.size());
+}
+
+TEST(TreeOperations, HintedAndFingerInsertion){
+    AVLTree<int> hinted, near;
+    set<int> expected;
+    auto hint = hinted.end();
+    for (int i = 0; i < 30000; ++i){
+        //mostly increasing with some late arrivals
+        int value = i * 4 - int(random() % 40);
+        hint = hinted.insert(hint, value);
+        ASSERT_EQ(value, *hint);
+        ASSERT_EQ(expected.insert(value).second, near.insertNear(value));
+        if (i % 1000 == 0){
+            hinted.deleteIfExists(value / 2);
+            near.deleteIfExists(value / 2);
+            expected.erase(value / 2);
+        }
+    }
+    ASSERT_TRUE(hinted == expected);
+    ASSERT_TRUE(near == expected);
+    ASSERT_TRUE(hasAVLHeight(near));
+
+    for (int i = 0; i < 10000; ++i){
+        int value = random() % 130000;
+        ASSERT_EQ(expected.count(value) > 0, near.containsNear(value));
+        auto position = hinted.insert(random() % 2 ? hinted.begin() : hinted.end(), value);
+        ASSERT_EQ(value, *position);
+        ASSERT_EQ(value, *--++position);
+        ASSERT_EQ(expected.insert(value).second, near.insertNear(value));
+    }
+    ASSERT_TRUE(hinted == expected);
+    ASSERT_TRUE(near == expected);
+}
+
+TEST(TreeOperations, BidirectionalIterators){
+    vector<int> vector(3000, 0);
+    generate(vector.begin(), vector.end(), [] () { return random() % 5000; });
+    AVLTree<int> tree(vector);
+    set<int> set(vector.begin(), vector.end());
+    ASSERT_TRUE(tree == set);
+    ASSERT_EQ(set.size(), size_t(distance(tree.begin(), tree.end())));
+    ASSERT_TRUE(equal(tree.rbegin(), tree.rend(), set.rbegin(), set.rend()));
+
+    auto sum = 0;
+    for (auto value : tree){
+        sum += value;
+    }
+    ASSERT_EQ(accumulate(set.begin(), set.end(), 0), sum);
+
+    auto it = tree.begin();
+    auto set_it = set.begin();
+    for (int i = 0; i < 100; ++i){
+        ASSERT_EQ(*set_it++, *it++);
+    }
+    for (int i = 0; i < 50; ++i){
+        ASSERT_EQ(*--set_it, *--it);
+    }
+    ASSERT_EQ(*set.rbegin(), *--tree.end());
+    ASSERT_EQ(*set.lower_bound(2500), *find_if(tree.begin(), tree.end(), [] (int value) { return value >= 2500; }));
+
+    auto snapshot = tree.snapshot();
+    tree.clear();
+    ASSERT_TRUE(tree.begin() == tree.end());
+    ASSERT_TRUE(equal(snapshot.begin(), snapshot.end(), set.begin(), set.end()));
+    ASSERT_TRUE(equal(snapshot.rbegin(), snapshot.rend(), set.rbegin(), set.rend()));
+}
+
+//the smallest trees of heights 1 to 5 hold 1, 2, 4, 7 and 12 values
+TEST(TreeOperations, IteratorPathsFitTheHeightBound){
+    ASSERT_EQ(1, avlHeightBound(1));
+    ASSERT_EQ(3, avlHeightBound(6));
+    ASSERT_EQ(4, avlHeightBound(7));
+    ASSERT_EQ(5, avlHeightBound(12));
+    ASSERT_EQ(91, avlHeightBound(numeric_limits<uint64_t>::max()));
+    ASSERT_EQ(45, avlHeightBound(numeric_limits<uint32_t>::max()));
+    ASSERT_LE(sizeof(AVLTree<int, less<int>, NoAggregate, CompactLayout>::iterator), 400);
+}
+TEST(TreeOperations, SaveAndLoad){
+    vector<double> vector(20000, 0);
+    generate(vector.begin(), vector.end(), [] () { return random() % 100000 / 7.0; });
+    AVLTree<double, greater<double>> tree(vector);
+    stringstream stream;
+    tree.save(stream);
+    auto loaded = AVLTree<double, greater<double>>::load(stream);
+    ASSERT_EQ(tree.toArray(), loaded.toArray());
+    ASSERT_TRUE(hasAVLHeight(loaded));
+
+    auto path = testing::TempDir() + "avl_tree_save_and_load.bin";
+    {
+        ofstream file(path, ios::binary);
+        tree.save(file);
+    }
+    auto mapped = AVLTree<double, greater<double>>::loadMapped(path);
+    ASSERT_EQ(tree.toArray(), mapped.toArray());
+    ASSERT_THROW(AVLTree<double>::loadMapped(path), std::runtime_error);
+    ASSERT_THROW(AVLTree<float>::loadMapped(path), std::runtime_error);
+    remove(path.c_str());
+
+    stringstream empty;
+    AVLTree<int>().save(empty);
+    ASSERT_EQ(0, AVLTree<int>::load(empty).size());
+    auto bytes = stream.str();
+    stringstream truncated(bytes.substr(0, bytes.size() - 1));
+    ASSERT_THROW((AVLTree<double, greater<double>>::load(truncated)), std::runtime_error);
+
+    //sizes whose byte count wraps around or that the stream cannot back
+    for (uint64_t corrupt_size : {(uint64_t(1) << 62) + 3, uint64_t(1) << 40}){
+        auto corrupt = bytes;
+        std::memcpy(&corrupt[offsetof(FileHeader, size)], &corrupt_size, sizeof(corrupt_size));
+        stringstream corrupt_stream(corrupt);
+        ASSERT_THROW((AVLTree<double, greater<double>>::load(corrupt_stream)), std::runtime_error);
+    }
+}
+
+TEST(TreeOperations, BuildFromSortedIsBalanced){
+    for (size_t size : {0, 1, 2, 3, 7, 8, 1000, 1 << 16}){
+        vector<int> vector(size);
+        iota(vector.begin(), vector.end(), 0);
+        AVLTree<int> tree(vector);
+        AVLTree<int> tagged(sortedUnique, vector);
+
+        size_t expected_height = 0;
+        while ((size_t(1) << expected_height) <= size){
+            ++expected_height;
+        }
+        ASSERT_EQ(size, tree.size());
+        ASSERT_EQ(expected_height, tree.height());
+        ASSERT_EQ(vector, tree.toArray());
+        ASSERT_EQ(vector, tagged.toArray());
+    }
+}
+
+TEST(TreeOperations, BuildFromUnsortedWithComparator){
+    size_t size = 10000;
+    vector<int> vector(size, 0);
+    int modulus = 2000;
+    generate(vector.begin(), vector.end(), [modulus] () { return random() % modulus; });
+    AVLTree<int, greater<int>> tree(vector);
+    auto copy = vector;
+    AVLTree<int, greater<int>> moved(std::move(copy));
+
+    std::sort(vector.begin(), vector.end(), greater<int>());
+    vector.erase(unique(vector.begin(), vector.end()), vector.end());
+    ASSERT_EQ(vector, tree.toArray());
+    ASSERT_EQ(vector, moved.toArray());
+
+    for (auto el : vector){
+        tree.deleteIfExists(el);
+        tree.insert(el + modulus);
+    }
+    ASSERT_EQ(vector.size(), tree.size());
+}
+
 TEST(TreeOperations, SplitByValueOutOfBorders){
     size_t size = 100;
     vector<int> vector(size, 0);
@@ -76,6 +297,529 @@ TEST(TreeOperations, SplitByValueWithinBorders){
     auto splited = AVLTree<int>::split(tree, modulus, true);
 }
 
+TEST(TreeOperations, CopyMoveAndClearWithStrings){
+    AVLTree<string> tree;
+    for (int i = 0; i < 1000; ++i){
+        tree.insert("key_" + to_string(random() % 500));
+    }
+    for (int i = 0; i < 300; ++i){
+        tree.deleteIfExists("key_" + to_string(random() % 500));
+    }
+
+    AVLTree<string> copy(tree);
+    ASSERT_EQ(tree.toArray(), copy.toArray());
+    AVLTree<string> moved(std::move(copy));
+    ASSERT_EQ(0, copy.size());
+    ASSERT_EQ(tree.toArray(), moved.toArray());
+
+    copy = moved;
+    moved.clear();
+    ASSERT_EQ(0, moved.size());
+    ASSERT_EQ(tree.toArray(), copy.toArray());
+}
+
+TEST(TreeOperations, SplitHalvesOutliveSource){
+    vector<string> keys;
+    for (int i = 0; i < 100; ++i){
+        keys.push_back(to_string(1000 + i));
+    }
+    pair<AVLTree<string>, AVLTree<string>> halves;
+    {
+        AVLTree<string> tree(keys);
+        halves = AVLTree<string>::split(tree, "1050", true);
+        ASSERT_EQ(0, tree.size());
+    }
+    halves.first.insert("0999");
+    halves.second.deleteIfExists("1050");
+    ASSERT_EQ(51, halves.first.size());
+    ASSERT_EQ(49, halves.second.size());
+}
+
+TEST(OrderStatistics, MatchSortedArray){
+    size_t size = 5000;
+    vector<int> vector(size, 0);
+    int modulus = 20000;
+    generate(vector.begin(), vector.end(), [modulus] () { return random() % modulus; });
+    AVLTree<int> tree;
+    for (auto el : vector){
+        tree.insert(el);
+    }
+    auto sorted = tree.toArray();
+
+    for (size_t k = 0; k < sorted.size(); ++k){
+        ASSERT_EQ(sorted[k], tree.select(k));
+        ASSERT_EQ(k, tree.rank(sorted[k]));
+    }
+    ASSERT_THROW(tree.select(sorted.size()), std::out_of_range);
+
+    for (int i = 0; i < 1000; ++i){
+        int lo = random() % (modulus + 2) - 1;
+        int hi = random() % (modulus + 2) - 1;
+        auto lower = lower_bound(sorted.begin(), sorted.end(), lo);
+        auto upper = upper_bound(sorted.begin(), sorted.end(), lo);
+        ASSERT_EQ(size_t(lower - sorted.begin()), tree.rank(lo));
+        if (lower != sorted.end()){
+            ASSERT_EQ(*lower, *tree.lowerBound(lo));
+        }
+        else{
+            ASSERT_EQ(nullptr, tree.lowerBound(lo));
+        }
+        if (upper != sorted.end()){
+            ASSERT_EQ(*upper, *tree.upperBound(lo));
+        }
+        else{
+            ASSERT_EQ(nullptr, tree.upperBound(lo));
+        }
+
+        size_t expected = hi < lo ? 0 : upper_bound(sorted.begin(), sorted.end(), hi) - lower;
+        ASSERT_EQ(expected, tree.countInRange(lo, hi));
+    }
+}
+
+TEST(OrderStatistics, OnSnapshot){
+    AVLTree<int> tree = {10, 20, 30, 40};
+    auto snapshot = tree.snapshot();
+    tree.insert(25);
+    ASSERT_EQ(30, snapshot.select(2));
+    ASSERT_EQ(25, tree.select(2));
+    ASSERT_EQ(2, snapshot.rank(25));
+    ASSERT_EQ(1, snapshot.countInRange(21, 30));
+    ASSERT_EQ(30, *snapshot.lowerBound(25));
+    ASSERT_EQ(nullptr, snapshot.upperBound(40));
+}
+
+TEST(OrderStatistics, FrozenMatchesTree){
+    for (size_t size : {0, 1, 15, 16, 17, 1000, 4099}){
+        vector<int> vector(size, 0);
+        int modulus = 3 * int(size) + 1;
+        generate(vector.begin(), vector.end(), [modulus] () { return random() % modulus; });
+        AVLTree<int> tree(vector);
+        auto frozen = tree.freeze();
+        auto sorted = tree.toArray();
+        ASSERT_EQ(sorted.size(), frozen.size());
+        ASSERT_TRUE(equal(sorted.begin(), sorted.end(), frozen.begin(), frozen.end()));
+
+        for (int value = -1; value <= modulus; ++value){
+            ASSERT_EQ(tree.contains(value), frozen.contains(value));
+            ASSERT_EQ(tree.rank(value), frozen.rank(value));
+            ASSERT_EQ(tree.countInRange(value, value + 7), frozen.countInRange(value, value + 7));
+            auto lower = tree.lowerBound(value);
+            auto upper = tree.upperBound(value);
+            ASSERT_EQ(lower == nullptr, frozen.lowerBound(value) == nullptr);
+            ASSERT_EQ(upper == nullptr, frozen.upperBound(value) == nullptr);
+            if (lower){
+                ASSERT_EQ(*lower, *frozen.lowerBound(value));
+                ASSERT_EQ(*lower, *(frozen.begin() + frozen.rank(value)));
+            }
+            if (upper){
+                ASSERT_EQ(*upper, *frozen.upperBound(value));
+            }
+        }
+        ASSERT_THROW(frozen.select(size), std::out_of_range);
+    }
+
+    AVLTree<string, greater<string>> words{"pear", "apple", "fig", "kiwi", "plum", "date"};
+    auto snapshot = words.snapshot();
+    words.insert("lime");
+    auto frozen = snapshot.freeze();
+    ASSERT_EQ(snapshot.toArray(), frozen.toArray());
+    ASSERT_FALSE(frozen.contains("lime"));
+    ASSERT_TRUE(frozen.contains("kiwi"));
+    ASSERT_EQ(2, frozen.rank("kiwi"));
+    ASSERT_EQ("fig", *frozen.lowerBound("grape"));
+    ASSERT_EQ(3, frozen.countInRange("pear", "fig"));
+}
+
+TEST(TreeOperations, EraseAndExtractRange){
+    size_t size = 20000;
+    vector<int> vector(size, 0);
+    int modulus = 50000;
+    generate(vector.begin(), vector.end(), [modulus] () { return random() % modulus; });
+    AVLTree<int> tree(vector);
+    std::set<int> expected(vector.begin(), vector.end());
+
+    for (int i = 0; i < 50; ++i){
+        int lo = random() % modulus;
+        int hi = lo + random() % 2000;
+        auto extracted = tree.extractRange(lo, hi);
+        std::vector<int> expected_extracted(expected.lower_bound(lo), expected.upper_bound(hi));
+        expected.erase(expected.lower_bound(lo), expected.upper_bound(hi));
+        ASSERT_EQ(expected_extracted, extracted.toArray());
+        ASSERT_TRUE(hasAVLHeight(extracted));
+
+        lo = random() % modulus;
+        hi = lo + random() % 2000;
+        tree.eraseRange(lo, hi);
+        expected.erase(expected.lower_bound(lo), expected.upper_bound(hi));
+        ASSERT_EQ(std::vector<int>(expected.begin(), expected.end()), tree.toArray());
+        ASSERT_TRUE(hasAVLHeight(tree));
+    }
+    tree.eraseRange(10, 5);
+    ASSERT_EQ(expected.size(), tree.size());
+}
+
+TEST(TreeOperations, RangesFollowComparator){
+    AVLTree<string, greater<string>> tree = {"a", "b", "c", "d", "e", "f"};
+    auto extracted = tree.extractRange("e", "c");
+    ASSERT_EQ(vector<string>({"e", "d", "c"}), extracted.toArray());
+    ASSERT_EQ(vector<string>({"f", "b", "a"}), tree.toArray());
+    tree.eraseRange("z", "b");
+    ASSERT_EQ(vector<string>({"a"}), tree.toArray());
+    for (int i = 0; i < 10; ++i){
+        tree.insert(to_string(i));
+    }
+    ASSERT_EQ(11, tree.size());
+
+    auto halves = AVLTree<string, greater<string>>::split(tree, "5", true);
+    ASSERT_EQ(vector<string>({"a", "9", "8", "7", "6"}), halves.first.toArray());
+}
+
+struct CopyCounted{
+    static int copies;
+
+    std::string key;
+
+    explicit CopyCounted(std::string key) : key(std::move(key)) {}
+
+    CopyCounted(const CopyCounted &other) : key(other.key) { ++copies; }
+
+    CopyCounted(CopyCounted &&other) = default;
+
+    bool operator<(const CopyCounted &other) const { return key < other.key; }
+};
+
+int CopyCounted::copies = 0;
+
+TEST(TreeOperations, CompactLayoutMatchesStdSet){
+    using CompactTree = AVLTree<int, less<int>, SumOf<int>, CompactLayout>;
+    CompactTree tree;
+    set<int> expected;
+    for (int i = 0; i < 50000; ++i){
+        int value = random() % 20000;
+        if (random() % 3){
+            ASSERT_EQ(expected.insert(value).second, tree.insert(value));
+        }
+        else{
+            ASSERT_EQ(expected.erase(value) > 0, tree.deleteIfExists(value));
+        }
+    }
+    ASSERT_TRUE(tree == expected);
+    ASSERT_LE(tree.height(), 1.45 * log2(tree.size() + 2));
+    ASSERT_EQ(accumulate(expected.begin(), expected.end(), 0), tree.aggregate());
+
+    auto snapshot = tree.snapshot();
+    auto halves = CompactTree::split(tree, 10000, true);
+    vector<int> batch = {-1, -2, 30000};
+    halves.second.insertBatch(batch.begin(), batch.end());
+    halves.first.uniteWith(std::move(halves.second));
+    ASSERT_EQ(expected.size() + 3, halves.first.size());
+    ASSERT_TRUE(equal(expected.begin(), expected.end(), snapshot.begin()));
+    ASSERT_EQ(*expected.rbegin(), *snapshot.rbegin());
+}
+
+TEST(TreeOperations, CompactNodesAreSmaller){
+    size_t pointer_node = AVLTree<int>::nodeSize();
+    size_t compact_node = AVLTree<int, less<int>, NoAggregate, CompactLayout>::nodeSize();
+    ASSERT_LE(10 * compact_node, 7 * pointer_node);
+    if (sizeof(void *) == 8){
+        ASSERT_EQ(40, pointer_node);
+        ASSERT_EQ(28, compact_node);
+    }
+}
+
+//every compact tree takes slab numbers from a process-wide table, they must come back when it is destroyed
+TEST(TreeOperations, CompactTreesReleaseSlabNumbers){
+    using CompactTree = AVLTree<int, less<int>, NoAggregate, CompactLayout>;
+    for (size_t i = 0; i < SlabTable::max_slabs + 1000; ++i){
+        CompactTree tree;
+        ASSERT_TRUE(tree.insert(int(i)));
+    }
+    CompactTree tree;
+    ASSERT_TRUE(tree.insert(1));
+}
+
+TEST(TreeOperations, MovesAndHeterogeneousLookup){
+    AVLTree<CopyCounted> counted;
+    for (int i = 0; i < 1000; ++i){
+        ASSERT_TRUE(counted.insert(CopyCounted(to_string(i))));
+        ASSERT_TRUE(counted.emplace(to_string(i) + "e"));
+    }
+    ASSERT_FALSE(counted.insert(CopyCounted("7")));
+    ASSERT_FALSE(counted.emplace("7e"));
+    for (int i = 0; i < 1000; i += 3){
+        ASSERT_TRUE(counted.contains(CopyCounted(to_string(i))));
+        ASSERT_TRUE(counted.deleteIfExists(CopyCounted(to_string(i))));
+        ASSERT_FALSE(counted.deleteIfExists(CopyCounted(to_string(i))));
+    }
+    ASSERT_EQ(0, CopyCounted::copies);
+    ASSERT_EQ(2000 - 334, counted.size());
+    ASSERT_TRUE(hasAVLHeight(counted));
+
+    AVLTree<string, less<>> words{"pear", "apple", "fig"};
+    const char *kiwi = "kiwi";
+    ASSERT_FALSE(words.contains(kiwi));
+    ASSERT_TRUE(words.emplace(kiwi));
+    ASSERT_EQ("kiwi", *words.find(kiwi));
+    ASSERT_EQ(nullptr, words.find("plum"));
+    ASSERT_TRUE(words.deleteIfExists("fig"));
+    auto snapshot = words.snapshot();
+    ASSERT_TRUE(words.deleteIfExists("pear"));
+    ASSERT_TRUE(snapshot.contains("pear"));
+    ASSERT_FALSE(words.contains("pear"));
+    ASSERT_EQ(vector<string>({"apple", "kiwi"}), words.toArray());
+}
+
+TEST(TreeOperations, BatchInsertAndErase){
+    int modulus = 100000;
+    AVLTree<int> tree;
+    std::set<int> expected;
+    for (size_t batch_size : {1, 10, 1000, 50000}){
+        vector<int> batch(batch_size);
+        generate(batch.begin(), batch.end(), [modulus] () { return random() % modulus; });
+        size_t old_size = expected.size();
+        expected.insert(batch.begin(), batch.end());
+        ASSERT_EQ(expected.size() - old_size, tree.insertBatch(batch.begin(), batch.end()));
+        ASSERT_TRUE(hasAVLHeight(tree));
+
+        generate(batch.begin(), batch.end(), [modulus] () { return random() % modulus; });
+        size_t erased = 0;
+        for (auto el : std::set<int>(batch.begin(), batch.end())){
+            erased += expected.erase(el);
+        }
+        ASSERT_EQ(erased, tree.eraseBatch(batch.begin(), batch.end()));
+        ASSERT_TRUE(hasAVLHeight(tree));
+        ASSERT_EQ(vector<int>(expected.begin(), expected.end()), tree.toArray());
+    }
+
+    auto snapshot = tree.snapshot();
+    vector<int> batch = {-1, -2, 5, modulus};
+    tree.insertBatch(batch.begin(), batch.end());
+    tree.eraseBatch(batch.begin(), batch.begin() + 2);
+    ASSERT_EQ(vector<int>(expected.begin(), expected.end()), snapshot.toArray());
+    ASSERT_TRUE(tree.contains(modulus));
+}
+
+struct Concatenation{
+    using value_type = string;
+
+    static string identity() { return ""; }
+
+    static string combine(const string &left, const string &right) { return left + right; }
+
+    static string lift(const string &value) { return value; }
+};
+
+TEST(AugmentedMap, RangeAggregatesMatchStdMap){
+    AVLMap<int, long long, SumOf<long long>> sums;
+    AVLMap<int, long long, MinOf<long long>, greater<int>> minimums;
+    map<int, long long> expected;
+    for (int i = 0; i < 20000; ++i){
+        int key = random() % 3000;
+        long long value = random() % 1000 - 500;
+        if (random() % 4 == 0){
+            ASSERT_EQ(expected.erase(key) > 0, sums.erase(key));
+            minimums.erase(key);
+        }
+        else{
+            ASSERT_EQ(expected.count(key) == 0, sums.insertOrAssign(key, value));
+            minimums.insertOrAssign(key, value);
+            expected[key] = value;
+        }
+    }
+    ASSERT_EQ(expected.size(), sums.size());
+    ASSERT_TRUE(equal(expected.begin(), expected.end(), sums.begin(), [] (const pair<const int, long long> &first, const pair<int, long long> &second){
+        return first.first == second.first && first.second == second.second;
+    }));
+    ASSERT_EQ(*sums.find(expected.begin()->first), expected.begin()->second);
+    ASSERT_EQ(nullptr, sums.find(-1));
+
+    for (int i = 0; i < 500; ++i){
+        int lo = random() % 3100 - 50;
+        int hi = lo + random() % 400;
+        long long sum = 0;
+        long long minimum = numeric_limits<long long>::max();
+        for (auto it = expected.lower_bound(lo); it != expected.end() && it->first <= hi; ++it){
+            sum += it->second;
+            minimum = std::min(minimum, it->second);
+        }
+        ASSERT_EQ(sum, sums.aggregate(lo, hi));
+        ASSERT_EQ(minimum, minimums.aggregate(hi, lo));
+    }
+
+    long long total = 0;
+    for (auto &entry : expected){
+        total += entry.second;
+    }
+    ASSERT_EQ(total, sums.aggregate());
+    auto middle = sums.extractRange(1000, 1999);
+    ASSERT_EQ(total, sums.aggregate() + middle.aggregate());
+    ASSERT_EQ(middle.aggregate(), middle.aggregate(1000, 1999));
+    ASSERT_EQ(0, sums.aggregate(1000, 1999));
+}
+
+TEST(AugmentedMap, NonCommutativeAggregate){
+    AVLMap<int, string, Concatenation> letters;
+    string alphabet = "abcdefghijklmnopqrstuvwxyz";
+    for (int i = 25; i >= 0; --i){
+        letters.insert(i, string(1, alphabet[i]));
+    }
+    ASSERT_EQ(alphabet, letters.aggregate());
+    ASSERT_EQ("defg", letters.aggregate(3, 6));
+    letters.insertOrAssign(4, "E");
+    ASSERT_EQ("dEfg", letters.aggregate(3, 6));
+    letters.eraseRange(10, 19);
+    ASSERT_EQ("ijuv", letters.aggregate(8, 21));
+
+    AVLTree<int, less<int>, SumOf<int>> tree{5, 1, 4, 2, 3};
+    auto snapshot = tree.snapshot();
+    tree.deleteIfExists(4);
+    ASSERT_EQ(11, tree.aggregate());
+    ASSERT_EQ(9, snapshot.aggregate(2, 4));
+}
+
+//mapped values without a default constructor
+struct Label{
+    string text;
+
+    explicit Label(string text) : text(std::move(text)) {}
+};
+
+TEST(AugmentedMap, RangesOfValuesWithoutDefault){
+    AVLMap<int, Label> labels;
+    for (int i = 0; i < 100; ++i){
+        ASSERT_TRUE(labels.insert(i, Label(to_string(i))));
+    }
+    auto middle = labels.extractRange(40, 59);
+    ASSERT_EQ(20, middle.size());
+    ASSERT_EQ("40", middle.find(40)->text);
+    labels.eraseRange(0, 9);
+    ASSERT_EQ(70, labels.size());
+    ASSERT_FALSE(labels.contains(5));
+    ASSERT_FALSE(labels.contains(50));
+    ASSERT_EQ("60", labels.find(60)->text);
+}
+
+TEST(Sequence, EditsMatchVector){
+    AVLSequence<long long> sequence;
+    vector<long long> expected;
+    for (int i = 0; i < 20000; ++i){
+        size_t first = random() % (expected.size() + 1);
+        size_t last = first + random() % (expected.size() - first + 1);
+        switch (random() % 6){
+            case 0:
+            case 1:
+                sequence.insert(first, i);
+                expected.insert(expected.begin() + first, i);
+                break;
+            case 2:
+                sequence.erase(first, min(last, first + 3));
+                expected.erase(expected.begin() + first, expected.begin() + min(last, first + 3));
+                break;
+            case 3:
+                sequence.reverse(first, last);
+                std::reverse(expected.begin() + first, expected.begin() + last);
+                break;
+            case 4:
+                sequence.add(first, last, i % 7 - 3);
+                for_each(expected.begin() + first, expected.begin() + last, [i] (long long &value) { value += i % 7 - 3; });
+                break;
+            default:
+                if (first < expected.size()){
+                    ASSERT_EQ(expected[first], sequence.at(first));
+                    sequence.set(first, -i);
+                    expected[first] = -i;
+                }
+        }
+        ASSERT_EQ(expected.size(), sequence.size());
+    }
+    ASSERT_EQ(expected, sequence.toArray());
+    ASSERT_LE(sequence.height(), 1.45 * log2(sequence.size() + 2));
+    ASSERT_THROW(sequence.at(sequence.size()), std::out_of_range);
+    ASSERT_THROW(sequence.erase(1, 0), std::out_of_range);
+}
+
+TEST(Sequence, SplitAndConcatenate){
+    AVLSequence<string> words{"a", "b", "c", "d", "e", "f"};
+    words.reverse(1, 5);
+    auto tail = words.splitAt(3);
+    ASSERT_EQ(vector<string>({"a", "e", "d"}), words.toArray());
+    ASSERT_EQ(vector<string>({"c", "b", "f"}), tail.toArray());
+
+    AVLSequence<string> other{"x", "y"};
+    auto copy = other;
+    tail.append(std::move(other));
+    tail.append(std::move(words));
+    tail.pushFront("<");
+    tail.pushBack(">");
+    ASSERT_EQ(0, other.size());
+    ASSERT_EQ(vector<string>({"<", "c", "b", "f", "x", "y", "a", "e", "d", ">"}), tail.toArray());
+    ASSERT_EQ("y", tail.at(5));
+    ASSERT_EQ(vector<string>({"x", "y"}), copy.toArray());
+}
+
+TEST(Sharded, ConcurrentUpdatesAndQueries){
+    ShardedSet<int> sharded(8);
+    size_t thread_count = 4;
+    int per_thread = 20000;
+    vector<thread> threads;
+    for (size_t t = 0; t < thread_count; ++t){
+        threads.emplace_back([&sharded, t, thread_count, per_thread] (){
+            for (int i = 0; i < per_thread; ++i){
+                int value = i * int(thread_count) + int(t);
+                sharded.insert(value);
+                if (i % 3 == 0){
+                    sharded.deleteIfExists(value);
+                }
+                sharded.contains(value / 2);
+                if (i % 500 == 0){
+                    sharded.countInRange(value - 1000, value);
+                }
+            }
+        });
+    }
+    for (auto &thread : threads){
+        thread.join();
+    }
+
+    set<int> expected;
+    for (int i = 0; i < per_thread * int(thread_count); ++i){
+        if (i / int(thread_count) % 3 != 0){
+            expected.insert(i);
+        }
+    }
+    ASSERT_EQ(expected.size(), sharded.size());
+    ASSERT_GT(sharded.shardCount(), 1);
+    vector<int> sorted(expected.begin(), expected.end());
+    ASSERT_EQ(sorted, sharded.toArray());
+    for (size_t k = 0; k < sorted.size(); k += 97){
+        ASSERT_EQ(sorted[k], sharded.select(k));
+        ASSERT_EQ(k, sharded.rank(sorted[k]));
+    }
+    ASSERT_THROW(sharded.select(sorted.size()), std::out_of_range);
+
+    vector<int> scanned;
+    sharded.forEachInRange(30000, 50000, [&scanned] (int value) { scanned.push_back(value); });
+    ASSERT_EQ(vector<int>(expected.lower_bound(30000), expected.upper_bound(50000)), scanned);
+    ASSERT_EQ(scanned.size(), sharded.countInRange(30000, 50000));
+
+    for (int value : sorted){
+        sharded.deleteIfExists(value);
+    }
+    sharded.rebalance();
+    ASSERT_EQ(1, sharded.shardCount());
+    ASSERT_EQ(0, sharded.size());
+}
+
+TEST(Sharded, BuildFromVector){
+    vector<int> vector(50000, 0);
+    generate(vector.begin(), vector.end(), [] () { return random() % 100000; });
+    ShardedSet<int, greater<int>> sharded(vector, 4);
+    AVLTree<int, greater<int>> tree(vector);
+    ASSERT_EQ(tree.toArray(), sharded.toArray());
+    ASSERT_EQ(4, sharded.shardCount());
+    ASSERT_EQ(tree.rank(500), sharded.rank(500));
+}
+
 TEST(SetOperations, EmptyIntersection){
     size_t size = 200;
     vector<int> vector(size, 0);
@@ -151,6 +895,205 @@ TEST(SetOperations, Difference){
     ASSERT_EQ(0, intersection.size());
 }
 
+TEST(SetOperations, LargeSetsMatchStd){
+    size_t size = 200000;
+    int modulus = 600000;
+    vector<int> f_vector(size), s_vector(size / 3);
+    generate(f_vector.begin(), f_vector.end(), [modulus] () {return random() % modulus; });
+    generate(s_vector.begin(), s_vector.end(), [modulus] () {return random() % modulus; });
+    AVLTree<int> f_tree(f_vector);
+    AVLTree<int> s_tree(s_vector);
+    auto f_sorted = f_tree.toArray();
+    auto s_sorted = s_tree.toArray();
+
+    vector<int> expected_union, expected_intersection, expected_difference;
+    set_union(f_sorted.begin(), f_sorted.end(), s_sorted.begin(), s_sorted.end(), back_inserter(expected_union));
+    set_intersection(f_sorted.begin(), f_sorted.end(), s_sorted.begin(), s_sorted.end(), back_inserter(expected_intersection));
+    set_difference(f_sorted.begin(), f_sorted.end(), s_sorted.begin(), s_sorted.end(), back_inserter(expected_difference));
+
+    for (auto &result : {::setUnion(f_tree, s_tree), ::setIntersection(f_tree, s_tree), ::setDifference(f_tree, s_tree)}){
+        ASSERT_TRUE(hasAVLHeight(result));
+    }
+    ASSERT_EQ(expected_union, ::setUnion(f_tree, s_tree).toArray());
+    ASSERT_EQ(expected_intersection, ::setIntersection(f_tree, s_tree).toArray());
+    ASSERT_EQ(expected_difference, ::setDifference(f_tree, s_tree).toArray());
+    ASSERT_EQ(f_sorted, f_tree.toArray());
+    ASSERT_EQ(s_sorted, s_tree.toArray());
+
+    auto trees_union = ::setUnion(AVLTree<int>(f_tree), AVLTree<int>(s_tree));
+    ASSERT_EQ(expected_union, trees_union.toArray());
+    trees_union.insert(modulus);
+    ASSERT_EQ(expected_union.size() + 1, trees_union.size());
+}
+
+TEST(SetOperations, OperandsSharingPool){
+    vector<string> keys;
+    for (int i = 0; i < 1000; ++i){
+        keys.push_back(to_string(10000 + i));
+    }
+    AVLTree<string> tree(keys);
+    auto halves = AVLTree<string>::split(tree, "10500", true);
+    AVLTree<string> other = {"10100", "10200", "20000"};
+
+    halves.first.uniteWith(std::move(other));
+    ASSERT_EQ(0, other.size());
+    ASSERT_EQ(501, halves.first.size());
+
+    halves.second.subtract(AVLTree<string>(halves.first));
+    ASSERT_EQ(500, halves.second.size());
+    halves.first.intersectWith(std::move(halves.second));
+    ASSERT_EQ(0, halves.first.size());
+}
+
+TEST(SetOperations, MerkleEqualityAndDiff){
+    using HashedTree = AVLTree<int, less<int>, MerkleHash<int>>;
+    vector<int> values(5000);
+    iota(values.begin(), values.end(), 0);
+    HashedTree sorted_tree(values);
+    std::random_shuffle(values.begin(), values.end());
+    HashedTree shuffled_tree;
+    for (int value : values){
+        shuffled_tree.insert(value);
+    }
+    ASSERT_TRUE(sorted_tree == shuffled_tree);
+    ASSERT_TRUE(sorted_tree.diff(shuffled_tree).first.empty());
+
+    set<int> here(values.begin(), values.end()), there(here);
+    for (int i = 0; i < 20; ++i){
+        int value = random() % 6000;
+        sorted_tree.deleteIfExists(value);
+        here.erase(value);
+        value = random() % 6000;
+        shuffled_tree.insert(value);
+        there.insert(value);
+    }
+    ASSERT_FALSE(sorted_tree == shuffled_tree);
+
+    vector<int> only_here, only_there;
+    set_difference(here.begin(), here.end(), there.begin(), there.end(), back_inserter(only_here));
+    set_difference(there.begin(), there.end(), here.begin(), here.end(), back_inserter(only_there));
+    auto differences = sorted_tree.diff(shuffled_tree);
+    ASSERT_EQ(only_here, differences.first);
+    ASSERT_EQ(only_there, differences.second);
+    ASSERT_EQ(shuffled_tree.toArray(), shuffled_tree.diff(HashedTree()).first);
+}
+
+//every value hashes the same, so trees of one size always collide
+struct ConstantHash{
+    size_t operator()(int) const { return 0; }
+};
+
+TEST(SetOperations, MerkleEqualityConfirmsCollisions){
+    using CollidingTree = AVLTree<int, less<int>, MerkleHash<int, ConstantHash>>;
+    CollidingTree first(vector<int>{1, 2, 3});
+    CollidingTree second(vector<int>{4, 5, 6});
+    ASSERT_TRUE(first.aggregate() == second.aggregate());
+    ASSERT_TRUE(probablyEqual(first, second));
+    ASSERT_FALSE(first == second);
+    ASSERT_TRUE(first != second);
+
+    second = CollidingTree(vector<int>{1, 2, 3});
+    ASSERT_TRUE(first == second);
+}
+
+TEST(Snapshots, UnaffectedByLaterChanges){
+    AVLTree<string> tree;
+    for (int i = 0; i < 2000; ++i){
+        tree.insert(to_string(random() % 1000));
+    }
+    auto expected = tree.toArray();
+    auto snapshot = tree.snapshot();
+
+    for (int i = 0; i < 2000; ++i){
+        tree.insert(to_string(random() % 2000));
+        tree.deleteIfExists(to_string(random() % 2000));
+    }
+    auto later_expected = tree.toArray();
+    auto later = tree.snapshot();
+    tree.uniteWith(AVLTree<string>({"a", "b"}));
+    tree.subtract(AVLTree<string>({"a", "1"}));
+
+    ASSERT_EQ(expected, snapshot.toArray());
+    ASSERT_EQ(expected.size(), snapshot.size());
+    ASSERT_EQ(later_expected, later.toArray());
+    ASSERT_TRUE(snapshot.contains(expected.front()));
+    ASSERT_TRUE(tree.contains("b"));
+    ASSERT_FALSE(later.contains("b"));
+}
+
+TEST(Snapshots, OutliveTheTree){
+    vector<AVLTree<string>::Snapshot> snapshots;
+    vector<vector<string>> expected;
+    {
+        AVLTree<string> tree;
+        for (int round = 0; round < 5; ++round){
+            for (int i = 0; i < 300; ++i){
+                tree.insert(to_string(random() % 500));
+                tree.deleteIfExists(to_string(random() % 500));
+            }
+            snapshots.push_back(tree.snapshot());
+            expected.push_back(tree.toArray());
+        }
+        snapshots.erase(snapshots.begin() + 1);
+        expected.erase(expected.begin() + 1);
+        tree.insert("x");
+    }
+    for (size_t i = 0; i < snapshots.size(); ++i){
+        ASSERT_EQ(expected[i], snapshots[i].toArray());
+    }
+}
+
+TEST(Snapshots, SplitAndClearKeepSnapshots){
+    vector<int> vector(1000);
+    iota(vector.begin(), vector.end(), 0);
+    AVLTree<int> tree(vector);
+    auto snapshot = tree.snapshot();
+    auto halves = AVLTree<int>::split(tree, 500, true);
+    halves.first.insert(-1);
+    halves.second.deleteIfExists(700);
+    halves.first.uniteWith(std::move(halves.second));
+    ASSERT_EQ(1000, halves.first.size());
+    ASSERT_EQ(vector, snapshot.toArray());
+
+    halves.first.clear();
+    halves.first.insert(1);
+    ASSERT_EQ(vector, snapshot.toArray());
+}
+
+TEST(Snapshots, ConcurrentReaders){
+    AVLTree<int> tree;
+    atomic<bool> done(false);
+    mutex published_mutex;
+    auto published = make_shared<AVLTree<int>::Snapshot>(tree.snapshot());
+
+    auto reader = [&](){
+        while (!done){
+            shared_ptr<AVLTree<int>::Snapshot> snapshot;
+            {
+                lock_guard<mutex> lock(published_mutex);
+                snapshot = published;
+            }
+            auto values = snapshot->toArray();
+            ASSERT_EQ(snapshot->size(), values.size());
+            ASSERT_TRUE(is_sorted(values.begin(), values.end()));
+        }
+    };
+    thread first_reader(reader), second_reader(reader);
+
+    for (int i = 0; i < 20000; ++i){
+        tree.insert(random() % 5000);
+        tree.deleteIfExists(random() % 5000);
+        if (i % 500 == 0){
+            auto snapshot = make_shared<AVLTree<int>::Snapshot>(tree.snapshot());
+            lock_guard<mutex> lock(published_mutex);
+            published = snapshot;
+        }
+    }
+    done = true;
+    first_reader.join();
+    second_reader.join();
+}
+
 int main(int argc, char *argv[])
 {
     ::testing::InitGoogleTest(&argc, argv);
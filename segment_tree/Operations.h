@@ -0,0 +1,135 @@
+#pragma once
+
+#include <limits>
+#include <utility>
+#include <cstddef>
+#include <type_traits>
+
+//operation policies of SegmentTree: a stateless associative combine(left, right) and its identity().
+//the combine does not have to be commutative, the tree always passes the left range first.
+//operations that support range updates name their update_type and have apply(update, aggregate, length),
+//the aggregate of length elements after the update changed each of them. updates have isIdentity()
+//and update.after(inner), the update doing inner first
+
+//range update x -> multiplier * x + addend. adding v is (1, v), assigning v is (0, v)
+template<typename T>
+struct AffineUpdate{
+    T multiplier = T(1);
+    T addend = T();
+
+    //this update done after inner
+    AffineUpdate after(const AffineUpdate &inner) const {
+        return AffineUpdate{multiplier * inner.multiplier, multiplier * inner.addend + addend};
+    }
+
+    bool isIdentity() const { return multiplier == T(1) && addend == T(); }
+};
+
+//the update of operations without range updates
+struct NoUpdate{
+    bool isIdentity() const { return true; }
+
+    NoUpdate after(const NoUpdate &) const { return *this; }
+};
+
+//affine updates need arithmetic values, sums of strings or matrices have none
+template<typename T>
+using ArithmeticUpdate = typename std::conditional<std::is_arithmetic<T>::value, AffineUpdate<T>, NoUpdate>::type;
+
+template<typename...>
+struct MakeVoid{
+    using type = void;
+};
+
+//TOperation::update_type, NoUpdate when the operation has none
+template<typename TOperation, typename = void>
+struct UpdateOf{
+    using type = NoUpdate;
+};
+
+template<typename TOperation>
+struct UpdateOf<TOperation, typename MakeVoid<typename TOperation::update_type>::type>{
+    using type = typename TOperation::update_type;
+};
+
+template<typename TOperation, typename TUpdate, typename T>
+T applyUpdate(const TOperation &operation, const TUpdate &update, const T &aggregate, size_t length){
+    return operation.apply(update, aggregate, length);
+}
+
+template<typename TOperation, typename T>
+T applyUpdate(const TOperation &, const NoUpdate &, const T &aggregate, size_t){
+    return aggregate;
+}
+
+template<typename T>
+struct SumOperation{
+    using update_type = ArithmeticUpdate<T>;
+
+    static constexpr T identity() { return T(); }
+
+    T operator()(const T &left, const T &right) const { return left + right; }
+
+    T apply(const AffineUpdate<T> &update, const T &sum, size_t length) const {
+        return update.multiplier * sum + update.addend * T(length);
+    }
+};
+
+template<typename T>
+struct MinOperation{
+    using update_type = ArithmeticUpdate<T>;
+
+    static constexpr T identity() { return std::numeric_limits<T>::max(); }
+
+    T operator()(const T &left, const T &right) const { return right < left ? right : left; }
+
+    //multipliers must not be negative, they would turn the minimum into the maximum
+    T apply(const AffineUpdate<T> &update, const T &min, size_t) const { return update.multiplier * min + update.addend; }
+};
+
+template<typename T>
+struct MaxOperation{
+    using update_type = ArithmeticUpdate<T>;
+
+    static constexpr T identity() { return std::numeric_limits<T>::lowest(); }
+
+    T operator()(const T &left, const T &right) const { return left < right ? right : left; }
+
+    //multipliers must not be negative, they would turn the maximum into the minimum
+    T apply(const AffineUpdate<T> &update, const T &max, size_t) const { return update.multiplier * max + update.addend; }
+};
+
+//greatest common divisor of integers, never negative. signed values must be above the minimum,
+//whose magnitude does not fit in T
+template<typename T>
+struct GcdOperation{
+    static_assert(std::is_integral<T>::value, "the gcd needs integers");
+
+    static constexpr T identity() { return T(); }
+
+    T operator()(T left, T right) const {
+        while (right != 0){
+            T rest = left % right;
+            left = right;
+            right = rest;
+        }
+        return magnitude(left, std::is_signed<T>());
+    }
+
+private:
+    static T magnitude(T value, std::true_type) { return value < 0 ? -value : value; }
+
+    static T magnitude(T value, std::false_type) { return value; }
+};
+
+//over pairs (value, index): the largest value, the leftmost index among equal ones
+template<typename T>
+struct ArgMaxOperation{
+    static constexpr std::pair<T, size_t> identity() {
+        return std::pair<T, size_t>(std::numeric_limits<T>::lowest(), std::numeric_limits<size_t>::max());
+    }
+
+    std::pair<T, size_t> operator()(const std::pair<T, size_t> &left, const std::pair<T, size_t> &right) const {
+        return left.first < right.first ? right : left;
+    }
+};
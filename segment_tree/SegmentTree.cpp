@@ -1,89 +1,288 @@
 #include "SegmentTree.h"
 
-template<typename T>
-SegmentTree<T>::SegmentTree(const std::vector<T> &elements)
-        :elements(elements)
-        ,pow_2(pow(2, ceil(log(elements.size())/log(2)))){
-    buildTree();
-}
-
-template<typename T>
-void SegmentTree<T>::buildTree() {
-    std::queue<std::shared_ptr<Node>> layer;
-    for (auto el : elements){
-        layer.push(std::shared_ptr<Node>(new Node(el)));
-    }
-
-    while (layer.size() != 1){
-        size_t cur_size = layer.size();
-        for (size_t i = 0; i < cur_size; i += 2){
-            auto left = layer.front();
-            layer.pop();
-            std::shared_ptr<Node> right = nullptr;
-            if (i < cur_size - 1 || cur_size % 2 == 0){
-                right = layer.front();
-                layer.pop();
-            }
-            auto parent = std::shared_ptr<Node>(new Node(left->value + (right? right->value : 0), left, right));
-            layer.push(parent);
-        }
+template<typename T, typename TOperation>
+SegmentTree<T, TOperation>::SegmentTree(const std::vector<T> &elements)
+        :elements_count(elements.size())
+        ,pow_2(1)
+        ,height(0){
+    while (pow_2 < elements_count){
+        pow_2 *= 2;
+        ++height;
     }
+    buildTree(elements);
+}
 
-    root = layer.front();
-    layer.pop();
+template<typename T, typename TOperation>
+void SegmentTree<T, TOperation>::buildTree(const std::vector<T> &elements) {
+    tree.assign(2 * pow_2, neutral_element);
+    std::copy(elements.begin(), elements.end(), tree.begin() + pow_2);
+    for (size_t i = pow_2 - 1; i > 0; --i){
+        pull(i);
+    }
 }
 
-template<typename T>
-void SegmentTree<T>::set(size_t index, T value, std::shared_ptr<Node> &node, size_t left, size_t right) {
-    if (!node){
+template<typename T, typename TOperation>
+void SegmentTree<T, TOperation>::applyToNode(size_t node, const update_type &update, size_t length) {
+    tree[node] = applyUpdate(combine, update, tree[node], length);
+    if (node < pow_2){
+        updates[node] = update.after(updates[node]);
+    }
+}
+
+template<typename T, typename TOperation>
+void SegmentTree<T, TOperation>::push(size_t node, size_t length) {
+    if (updates[node].isIdentity()){
         return;
     }
+    applyToNode(2 * node, updates[node], length / 2);
+    applyToNode(2 * node + 1, updates[node], length / 2);
+    updates[node] = update_type();
+}
+
+template<typename T, typename TOperation>
+void SegmentTree<T, TOperation>::pull(size_t node) {
+    tree[node] = combine(tree[2 * node], tree[2 * node + 1]);
+}
 
-    if (right == left){ //redo
-        node->value = value;
+//passes the pending updates down to the leaf
+template<typename T, typename TOperation>
+void SegmentTree<T, TOperation>::pushPath(size_t leaf) {
+    if (!has_pending_updates){
         return;
     }
+    for (size_t level = height; level > 0; --level){
+        push(leaf >> level, size_t(1) << level);
+    }
+}
 
-    size_t m = (left + right) / 2;
-    if (index <= m){ //ends are included
-        set(index, value, node->left, left, m);
-    } else{
-        set(index, value, node->right, m + 1, right);
+template<typename T, typename TOperation>
+void SegmentTree<T, TOperation>::set(size_t index, T value) {
+    size_t node = pow_2 + index;
+    pushPath(node);
+    tree[node] = value;
+    for (node /= 2; node > 0; node /= 2){
+        pull(node);
     }
+}
 
-    node->value =
-            (node->left? node->left->value : 0)
-            +
-            (node->right? node->right->value : 0);
+//the pending update of node, applied to the aggregate of length elements below it
+template<typename T, typename TOperation>
+void SegmentTree<T, TOperation>::applyPending(T &result, size_t length, size_t node) const {
+    if (length > 0 && !updates[node].isIdentity()){
+        result = applyUpdate(combine, updates[node], result, length);
+    }
 }
 
-template<typename T>
-T SegmentTree<T>::sum(size_t left_border, size_t right_border, std::shared_ptr<Node> &node, size_t left, size_t right) {
+template<typename T, typename TOperation>
+T SegmentTree<T, TOperation>::query(size_t left_border, size_t right_border) const {
+    //half-open [left, right) climbs while the borders take the nodes that stick out of the parent ranges,
+    //the two sides are kept apart so the order of the elements is kept.
+    //the parents of the nodes a side takes all lie on the path of its border leaf, so with pending updates
+    //each level ends by applying the update of that path node to what the side holds so far
+    size_t first = pow_2 + left_border;
+    size_t last = pow_2 + right_border + 1; //ends are included
+    T left_result = neutral_element;
+    T right_result = neutral_element;
+    size_t left_length = 0;
+    size_t right_length = 0;
+    size_t level = 0;
+    for (size_t left = first, right = last, length = 1; left < right; left /= 2, right /= 2, length *= 2, ++level){
+        if (left % 2 == 1){
+            left_result = combine(left_result, tree[left++]);
+            left_length += length;
+        }
+        if (right % 2 == 1){
+            right_result = combine(tree[--right], right_result);
+            right_length += length;
+        }
+        if (has_pending_updates && level < height){
+            applyPending(left_result, left_length, first >> (level + 1));
+            applyPending(right_result, right_length, (last - 1) >> (level + 1));
+        }
+    }
+    for (; has_pending_updates && level < height; ++level){
+        applyPending(left_result, left_length, first >> (level + 1));
+        applyPending(right_result, right_length, (last - 1) >> (level + 1));
+    }
+    return combine(left_result, right_result);
+}
+
+template<typename T, typename TOperation>
+T SegmentTree<T, TOperation>::sum(size_t left_border, size_t right_border) const {
+    return query(left_border, right_border);
+}
+
+template<typename T, typename TOperation>
+void SegmentTree<T, TOperation>::update(size_t left_border, size_t right_border, const update_type &update) {
+    static_assert(!std::is_same<update_type, NoUpdate>::value, "the operation has no range updates");
+    if (updates.empty()){
+        updates.resize(pow_2);
+    }
+    has_pending_updates = true;
+
+    size_t first = pow_2 + left_border;
+    size_t last = pow_2 + right_border + 1; //ends are included
+    //the nodes above the borders get their pending updates out of the way first
+    for (size_t level = height; level > 0; --level){
+        if (((first >> level) << level) != first){
+            push(first >> level, size_t(1) << level);
+        }
+        if (((last >> level) << level) != last){
+            push((last - 1) >> level, size_t(1) << level);
+        }
+    }
+
+    size_t length = 1;
+    for (size_t left = first, right = last; left < right; left /= 2, right /= 2, length *= 2){
+        if (left % 2 == 1){
+            applyToNode(left++, update, length);
+        }
+        if (right % 2 == 1){
+            applyToNode(--right, update, length);
+        }
+    }
+
+    for (size_t level = 1; level <= height; ++level){
+        if (((first >> level) << level) != first){
+            pull(first >> level);
+        }
+        if (((last >> level) << level) != last){
+            pull((last - 1) >> level);
+        }
+    }
+}
+
+template<typename T, typename TOperation>
+void SegmentTree<T, TOperation>::flush() {
+    if (!has_pending_updates){
+        return;
+    }
+    //top down, a level at a time, so every update reaches the leaves
+    for (size_t level = height, first = 1; level > 0; --level, first *= 2){
+        for (size_t node = first; node < 2 * first; ++node){
+            push(node, size_t(1) << level);
+        }
+    }
+    has_pending_updates = false;
+}
+
+template<typename T, typename TOperation>
+void SegmentTree<T, TOperation>::add(size_t left_border, size_t right_border, T value) {
+    update(left_border, right_border, AffineUpdate<T>{T(1), value});
+}
+
+template<typename T, typename TOperation>
+void SegmentTree<T, TOperation>::assign(size_t left_border, size_t right_border, T value) {
+    update(left_border, right_border, AffineUpdate<T>{T(), value});
+}
+
+//visits the nodes left to right, a node whose aggregate keeps the predicate false is taken whole,
+//so only one node is descended into past the borders
+template<typename T, typename TOperation>
+template<typename TPredicate>
+size_t SegmentTree<T, TOperation>::findFirst(size_t left_border, size_t right_border, const TPredicate &predicate,
+                                             size_t node, size_t left, size_t right,
+                                             const update_type &pending, T &accumulated) const {
     if (left > right_border || right < left_border){
-        return neutral_element;
+        return elements_count;
     }
 
     if (left >= left_border && right <= right_border){
-        return node->value;
+        auto combined = combine(accumulated,
+                                pending.isIdentity() ? tree[node] : applyUpdate(combine, pending, tree[node], right - left + 1));
+        if (!predicate(combined)){
+            accumulated = combined;
+            return elements_count;
+        }
+        if (left == right){
+            return left;
+        }
     }
 
     size_t m = (left + right) / 2;
-    return sum(left_border, right_border, node->left, left, m)
-           + sum(left_border, right_border, node->right, m + 1, right);
+    auto inner = !has_pending_updates ? pending : pending.after(updates[node]);
+    size_t found = findFirst(left_border, right_border, predicate, 2 * node, left, m, inner, accumulated);
+    if (found != elements_count){
+        return found;
+    }
+    return findFirst(left_border, right_border, predicate, 2 * node + 1, m + 1, right, inner, accumulated);
+}
+
+template<typename T, typename TOperation>
+template<typename TPredicate>
+size_t SegmentTree<T, TOperation>::findFirst(size_t left_border, size_t right_border, const TPredicate &predicate) const {
+    T accumulated = neutral_element;
+    return findFirst(left_border, right_border, predicate, 1, 0, pow_2 - 1, update_type(), accumulated);
 }
 
-template<typename T>
-T SegmentTree<T>::sum(size_t left_border, size_t right_border) {
-    return sum(left_border, right_border, root, 0, pow_2 - 1);
+template<typename T, typename TOperation>
+size_t SegmentTree<T, TOperation>::findAtLeast(size_t left_border, size_t right_border, const T &value) const {
+    return findFirst(left_border, right_border, [&value](const T &aggregate) { return !(aggregate < value); });
 }
 
-template<typename T>
-void SegmentTree<T>::set(size_t index, T value) {
-    set(index, value, root, 0, pow_2 - 1);
+template<typename T, typename TOperation>
+size_t SegmentTree<T, TOperation>::findPrefix(const T &value) const {
+    if (elements_count == 0){
+        return 0;
+    }
+    return findAtLeast(0, elements_count - 1, value);
 }
 
-template<typename T>
-SegmentTree<T>::Node::Node(const T &value, std::shared_ptr<Node> left, std::shared_ptr<Node> right)
-        :value(value)
-        ,left(left)
-        ,right(right){}
+template<typename T, typename TOperation>
+std::vector<T> SegmentTree<T, TOperation>::queryBatch(const std::vector<std::pair<size_t, size_t>> &ranges,
+                                                      unsigned threads) const {
+    //queries never write to the tree, so the threads share it without locks
+    std::vector<T> results(ranges.size(), neutral_element);
+    auto answer = [&](size_t first, size_t last){
+        for (size_t i = first; i < last; ++i){
+            results[i] = query(ranges[i].first, ranges[i].second);
+        }
+    };
+
+    size_t chunks = std::min<size_t>(std::max(1u, threads), ranges.size() / batch_grain + 1);
+    size_t chunk = (ranges.size() + chunks - 1) / chunks;
+    std::vector<std::future<void>> forked;
+    for (size_t first = chunk; first < ranges.size(); first += chunk){
+        forked.push_back(std::async(std::launch::async, answer, first, std::min(first + chunk, ranges.size())));
+    }
+    answer(0, std::min(chunk, ranges.size()));
+    for (auto &task : forked){
+        task.get();
+    }
+    return results;
+}
+
+template<typename T, typename TOperation>
+void SegmentTree<T, TOperation>::updateBatch(std::vector<std::pair<size_t, T>> assignments) {
+    std::stable_sort(assignments.begin(), assignments.end(),
+                     [](const std::pair<size_t, T> &first, const std::pair<size_t, T> &second){
+                         return first.first < second.first;
+                     });
+
+    //parents of the written leaves, sorted as the leaves are
+    std::vector<size_t> nodes;
+    nodes.reserve(assignments.size());
+    for (size_t i = 0; i < assignments.size(); ++i){
+        if (i + 1 < assignments.size() && assignments[i + 1].first == assignments[i].first){
+            continue;
+        }
+        size_t leaf = pow_2 + assignments[i].first;
+        pushPath(leaf);
+        tree[leaf] = std::move(assignments[i].second);
+        nodes.push_back(leaf / 2);
+    }
+
+    //one level at a time, nodes shared by several leaves are pulled once
+    while (!nodes.empty() && nodes.front() > 0){
+        nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+        for (auto &node : nodes){
+            pull(node);
+            node /= 2;
+        }
+    }
+}
+
+template<typename T, typename TOperation>
+size_t SegmentTree<T, TOperation>::size() const {
+    return elements_count;
+}
@@ -1,35 +1,76 @@
 #pragma once
 
 #include <vector>
-#include <memory>
-#include <queue>
-#include <limits>
-#include <cmath>
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <future>
+#include <thread>
 
-template<typename T>
+#include "Operations.h"
+
+template<typename T, typename TOperation = SumOperation<T>>
 class SegmentTree {
+public:
+    using update_type = typename UpdateOf<TOperation>::type;
+
 private:
-    struct Node{
-        T value;
-        std::shared_ptr<Node> left;
-        std::shared_ptr<Node> right;
-    public:
-        explicit Node(const T &value, std::shared_ptr<Node> left = nullptr, std::shared_ptr<Node> right = nullptr);
-    };
-
-    std::vector<T> elements;
-    std::shared_ptr<Node> root;
-    T neutral_element = T();
+    //nodes in heap order: the root is 1, the children of i are 2i and 2i + 1, element i is the leaf pow_2 + i.
+    //leaves past the elements hold the neutral element, so every node covers an aligned power of two range
+    std::vector<T> tree;
+    //updates of inner nodes not yet passed to their children, the node values already include them.
+    //empty until the first range update
+    std::vector<update_type> updates;
+    //set by range updates, cleared by flush once no node holds one
+    bool has_pending_updates = false;
+    TOperation combine;
+    T neutral_element = TOperation::identity();
+    size_t elements_count;
     size_t pow_2;
+    size_t height;
+    //queries per thread below which a batch is not split further
+    static const size_t batch_grain = 1 << 12;
 
-    void set(size_t index, T value, std::shared_ptr<Node> &node, size_t left, size_t right);
-    T sum(size_t left_border, size_t right_border, std::shared_ptr<Node> &node, size_t left, size_t right);
-    void buildTree();
+    void buildTree(const std::vector<T> &elements);
+    void applyToNode(size_t node, const update_type &update, size_t length);
+    void push(size_t node, size_t length);
+    void pull(size_t node);
+    void pushPath(size_t leaf);
+    void applyPending(T &result, size_t length, size_t node) const;
+    template<typename TPredicate>
+    size_t findFirst(size_t left_border, size_t right_border, const TPredicate &predicate, size_t node, size_t left, size_t right,
+                     const update_type &pending, T &accumulated) const;
 
 public:
     explicit SegmentTree(const std::vector<T> &elements);
     void set(size_t index, T value);
-    T sum(size_t left_border, size_t right_border);
+    //combination of the elements from left_border to right_border, in this order
+    T query(size_t left_border, size_t right_border) const;
+    T sum(size_t left_border, size_t right_border) const;
+    //applies the update to the elements from left_border to right_border, O(log n).
+    //with affine updates x -> update.multiplier * x + update.addend.
+    //the update waits at inner nodes, queries apply the waiting updates above their borders on the way up
+    void update(size_t left_border, size_t right_border, const update_type &update);
+    void add(size_t left_border, size_t right_border, T value);
+    void assign(size_t left_border, size_t right_border, T value);
+    //applies every waiting update to the leaves, O(n). queries and searches no longer look at the waiting updates
+    void flush();
+    //first index i from left_border to right_border where predicate(query(left_border, i)) holds, size() if there is none.
+    //the predicate must turn true at most once along the range, O(log n)
+    template<typename TPredicate>
+    size_t findFirst(size_t left_border, size_t right_border, const TPredicate &predicate) const;
+    //first index i from left_border to right_border with query(left_border, i) >= value, size() if there is none:
+    //in max trees the first element that is at least value, in sums of non-negative elements the first prefix reaching it
+    size_t findAtLeast(size_t left_border, size_t right_border, const T &value) const;
+    //first index whose prefix sum is at least value, size() if there is none. elements must not be negative
+    size_t findPrefix(const T &value) const;
+    //query for every (left_border, right_border) range, split between up to threads threads for large batches
+    std::vector<T> queryBatch(const std::vector<std::pair<size_t, size_t>> &ranges,
+                              unsigned threads = std::thread::hardware_concurrency()) const;
+    //set for every (index, value), the last one wins for a repeated index. every changed node is recomputed once
+    void updateBatch(std::vector<std::pair<size_t, T>> assignments);
+    size_t size() const;
 };
 
 
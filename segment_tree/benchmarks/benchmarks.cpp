@@ -0,0 +1,241 @@
+#include "benchmark/benchmark.h"
+#include "SegmentTree.h"
+#include "SegmentTree.cpp"
+#include <vector>
+#include <random>
+#include <algorithm>
+
+using namespace std;
+
+//SegmentTree against a prefix-sum array and a Fenwick tree for build, point update and range sum.
+//run with --benchmark_out=<file> --benchmark_out_format=json, or build the benchmark_json target
+
+//operations timed per iteration of the update and sum benchmarks
+const size_t batch_size = 1024;
+
+//sums of all prefixes, O(1) range sums and O(n) updates
+template<typename T>
+class PrefixSums{
+private:
+    vector<T> elements;
+    vector<T> prefix;
+
+public:
+    explicit PrefixSums(const vector<T> &elements)
+            :elements(elements)
+            ,prefix(elements.size() + 1){
+        for (size_t i = 0; i < elements.size(); ++i){
+            prefix[i + 1] = prefix[i] + elements[i];
+        }
+    }
+
+    void set(size_t index, T value){
+        T delta = value - elements[index];
+        elements[index] = value;
+        for (size_t i = index + 1; i < prefix.size(); ++i){
+            prefix[i] += delta;
+        }
+    }
+
+    T sum(size_t left_border, size_t right_border) { return prefix[right_border + 1] - prefix[left_border]; }
+};
+
+//binary indexed tree over 1-based positions, O(log n) updates and range sums
+template<typename T>
+class FenwickTree{
+private:
+    vector<T> elements;
+    vector<T> tree;
+
+    void add(size_t index, T delta){
+        for (size_t i = index + 1; i < tree.size(); i += i & -i){
+            tree[i] += delta;
+        }
+    }
+
+    //sum of the first count elements
+    T prefix(size_t count){
+        T result = T();
+        for (size_t i = count; i > 0; i -= i & -i){
+            result += tree[i];
+        }
+        return result;
+    }
+
+public:
+    explicit FenwickTree(const vector<T> &elements)
+            :elements(elements)
+            ,tree(elements.size() + 1){
+        //linear build, every node passes its partial sum to its parent
+        for (size_t i = 1; i < tree.size(); ++i){
+            tree[i] += elements[i - 1];
+            size_t parent = i + (i & -i);
+            if (parent < tree.size()){
+                tree[parent] += tree[i];
+            }
+        }
+    }
+
+    void set(size_t index, T value){
+        add(index, value - elements[index]);
+        elements[index] = value;
+    }
+
+    T sum(size_t left_border, size_t right_border) { return prefix(right_border + 1) - prefix(left_border); }
+};
+
+//the array of a run, generated once per size
+const vector<int64_t> &elements(size_t n){
+    static vector<int64_t> result;
+    if (result.size() != n){
+        mt19937_64 random(n);
+        result.resize(n);
+        for (auto &element : result){
+            element = int64_t(random() % 1000000);
+        }
+    }
+    return result;
+}
+
+//random inclusive ranges [first, second]
+vector<pair<size_t, size_t>> ranges(size_t n){
+    mt19937_64 random(1);
+    vector<pair<size_t, size_t>> result(batch_size);
+    for (auto &range : result){
+        range = make_pair(size_t(random() % n), size_t(random() % n));
+        if (range.first > range.second){
+            swap(range.first, range.second);
+        }
+    }
+    return result;
+}
+
+template<class Structure>
+void BM_Build(benchmark::State &state){
+    auto &values = elements(state.range(0));
+    for (auto _ : state){
+        Structure structure(values);
+        benchmark::DoNotOptimize(&structure);
+    }
+    state.SetItemsProcessed(state.iterations() * values.size());
+}
+
+template<class Structure>
+void BM_PointUpdate(benchmark::State &state){
+    size_t n = state.range(0);
+    Structure structure(elements(n));
+    auto positions = ranges(n);
+    int64_t value = 0;
+    for (auto _ : state){
+        for (auto &position : positions){
+            structure.set(position.first, ++value);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * positions.size());
+}
+
+template<class Structure>
+void BM_RangeSum(benchmark::State &state){
+    size_t n = state.range(0);
+    Structure structure(elements(n));
+    auto queries = ranges(n);
+    for (auto _ : state){
+        for (auto &query : queries){
+            benchmark::DoNotOptimize(structure.sum(query.first, query.second));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * queries.size());
+}
+
+//lazy range updates, only the segment tree has them
+template<class Structure>
+void BM_RangeAdd(benchmark::State &state){
+    size_t n = state.range(0);
+    Structure structure(elements(n));
+    auto updates = ranges(n);
+    for (auto _ : state){
+        for (auto &update : updates){
+            structure.add(update.first, update.second, 1);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * updates.size());
+}
+
+//first index whose prefix sum reaches a random target
+template<class Structure>
+void BM_FindPrefix(benchmark::State &state){
+    size_t n = state.range(0);
+    Structure structure(elements(n));
+    auto total = structure.sum(0, n - 1);
+    mt19937_64 random(1);
+    vector<int64_t> targets(batch_size);
+    for (auto &target : targets){
+        target = int64_t(random() % uint64_t(total)) + 1;
+    }
+    for (auto _ : state){
+        for (auto &target : targets){
+            benchmark::DoNotOptimize(structure.findPrefix(target));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * targets.size());
+}
+
+//the range sums of 64 batches in one call
+template<class Structure>
+void BM_QueryBatch(benchmark::State &state){
+    size_t n = state.range(0);
+    Structure structure(elements(n));
+    vector<pair<size_t, size_t>> queries;
+    for (size_t i = 0; i < 64; ++i){
+        auto batch = ranges(n);
+        queries.insert(queries.end(), batch.begin(), batch.end());
+    }
+    for (auto _ : state){
+        benchmark::DoNotOptimize(structure.queryBatch(queries));
+    }
+    state.SetItemsProcessed(state.iterations() * queries.size());
+}
+
+template<class Structure>
+void BM_UpdateBatch(benchmark::State &state){
+    size_t n = state.range(0);
+    Structure structure(elements(n));
+    vector<pair<size_t, int64_t>> assignments;
+    int64_t value = 0;
+    for (auto &position : ranges(n)){
+        assignments.emplace_back(position.first, ++value);
+    }
+    for (auto _ : state){
+        structure.updateBatch(assignments);
+    }
+    state.SetItemsProcessed(state.iterations() * assignments.size());
+}
+
+//sizes from 1K in steps of 10
+void sizes(benchmark::internal::Benchmark *benchmark, int64_t max_size){
+    benchmark->ArgName("n")->Unit(benchmark::kMicrosecond);
+    for (int64_t n = 1000; n <= max_size; n *= 10){
+        benchmark->Arg(n);
+    }
+}
+
+void allSizes(benchmark::internal::Benchmark *benchmark) { sizes(benchmark, int64_t(BENCHMARK_MAX_SIZE)); }
+
+//prefix-sum updates are linear, past 1M a run takes minutes and tells nothing new
+void linearUpdateSizes(benchmark::internal::Benchmark *benchmark) { sizes(benchmark, min(int64_t(BENCHMARK_MAX_SIZE), int64_t(1000000))); }
+
+BENCHMARK_TEMPLATE(BM_Build, SegmentTree<int64_t>)->Apply(allSizes);
+BENCHMARK_TEMPLATE(BM_Build, PrefixSums<int64_t>)->Apply(allSizes);
+BENCHMARK_TEMPLATE(BM_Build, FenwickTree<int64_t>)->Apply(allSizes);
+BENCHMARK_TEMPLATE(BM_PointUpdate, SegmentTree<int64_t>)->Apply(allSizes);
+BENCHMARK_TEMPLATE(BM_PointUpdate, PrefixSums<int64_t>)->Apply(linearUpdateSizes);
+BENCHMARK_TEMPLATE(BM_PointUpdate, FenwickTree<int64_t>)->Apply(allSizes);
+BENCHMARK_TEMPLATE(BM_RangeSum, SegmentTree<int64_t>)->Apply(allSizes);
+BENCHMARK_TEMPLATE(BM_RangeSum, PrefixSums<int64_t>)->Apply(allSizes);
+BENCHMARK_TEMPLATE(BM_RangeSum, FenwickTree<int64_t>)->Apply(allSizes);
+BENCHMARK_TEMPLATE(BM_RangeAdd, SegmentTree<int64_t>)->Apply(allSizes);
+BENCHMARK_TEMPLATE(BM_FindPrefix, SegmentTree<int64_t>)->Apply(allSizes);
+BENCHMARK_TEMPLATE(BM_QueryBatch, SegmentTree<int64_t>)->Apply(allSizes);
+BENCHMARK_TEMPLATE(BM_UpdateBatch, SegmentTree<int64_t>)->Apply(allSizes);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,449 @@
+#include "gtest/gtest.h"
+#include "SegmentTree.h"
+#include "SegmentTree.cpp"
+#include <vector>
+#include <random>
+#include <algorithm>
+
+using namespace std;
+
+//sizes around powers of two, where the padding of the leaf row changes
+const vector<size_t> test_sizes = {1, 2, 3, 5, 7, 8, 9, 100, 1000, 1025};
+
+template<typename T>
+T plainSum(const vector<T> &elements, size_t left_border, size_t right_border){
+    T result = T();
+    for (size_t i = left_border; i <= right_border; ++i){
+        result += elements[i];
+    }
+    return result;
+}
+
+//a random inclusive range of n elements
+pair<size_t, size_t> randomRange(mt19937 &random, size_t n){
+    size_t left = random() % n;
+    size_t right = random() % n;
+    return left <= right ? make_pair(left, right) : make_pair(right, left);
+}
+
+TEST(PointOperations, EmptyAndSingleElement){
+    SegmentTree<long long> empty(vector<long long>{});
+    ASSERT_EQ(0, empty.size());
+
+    SegmentTree<long long> single(vector<long long>{7});
+    ASSERT_EQ(1, single.size());
+    ASSERT_EQ(7, single.sum(0, 0));
+    single.set(0, -3);
+    ASSERT_EQ(-3, single.sum(0, 0));
+}
+
+TEST(PointOperations, SetAndSumMatchVector){
+    mt19937 random(1);
+    for (size_t n : test_sizes){
+        vector<long long> elements(n);
+        generate(elements.begin(), elements.end(), [&random] () { return (long long)(random() % 200) - 100; });
+        SegmentTree<long long> tree(elements);
+        ASSERT_EQ(n, tree.size());
+        ASSERT_EQ(plainSum(elements, 0, n - 1), tree.sum(0, n - 1));
+
+        for (int i = 0; i < 2000; ++i){
+            size_t index = random() % n;
+            elements[index] = (long long)(random() % 200) - 100;
+            tree.set(index, elements[index]);
+            auto range = randomRange(random, n);
+            ASSERT_EQ(plainSum(elements, range.first, range.second), tree.sum(range.first, range.second));
+        }
+        //every single element, including the last ones before the padding
+        for (size_t i = 0; i < n; ++i){
+            ASSERT_EQ(elements[i], tree.sum(i, i));
+        }
+    }
+}
+
+//applies random adds, assignments, affine updates and sets to the trees and a plain vector, checking every query
+template<typename TSum, typename TMin, typename TMax>
+void checkRangeUpdates(size_t n, mt19937 &random, TSum &sums, TMin &minimums, TMax &maximums, vector<long long> &elements){
+    for (int i = 0; i < 2000; ++i){
+        auto range = randomRange(random, n);
+        long long value = (long long)(random() % 21) - 10;
+        long long multiplier = random() % 3;
+        switch (random() % 4){
+            case 0:
+                for (size_t k = range.first; k <= range.second; ++k){
+                    elements[k] += value;
+                }
+                sums.add(range.first, range.second, value);
+                minimums.add(range.first, range.second, value);
+                maximums.add(range.first, range.second, value);
+                break;
+            case 1:
+                for (size_t k = range.first; k <= range.second; ++k){
+                    elements[k] = value;
+                }
+                sums.assign(range.first, range.second, value);
+                minimums.assign(range.first, range.second, value);
+                maximums.assign(range.first, range.second, value);
+                break;
+            case 2:
+                for (size_t k = range.first; k <= range.second; ++k){
+                    elements[k] = multiplier * elements[k] + value;
+                }
+                sums.update(range.first, range.second, AffineUpdate<long long>{multiplier, value});
+                minimums.update(range.first, range.second, AffineUpdate<long long>{multiplier, value});
+                maximums.update(range.first, range.second, AffineUpdate<long long>{multiplier, value});
+                break;
+            default:
+                elements[range.first] = value;
+                sums.set(range.first, value);
+                minimums.set(range.first, value);
+                maximums.set(range.first, value);
+        }
+        //doubling keeps the values small as long as assignments come often enough, clamp them anyway
+        for (size_t k = 0; k < n; ++k){
+            if (elements[k] > 1000000 || elements[k] < -1000000){
+                elements[k] = 0;
+                sums.set(k, 0);
+                minimums.set(k, 0);
+                maximums.set(k, 0);
+            }
+        }
+
+        auto query = randomRange(random, n);
+        auto first = elements.begin() + query.first;
+        auto last = elements.begin() + query.second + 1;
+        ASSERT_EQ(plainSum(elements, query.first, query.second), sums.sum(query.first, query.second));
+        ASSERT_EQ(plainSum(elements, query.first, query.second), sums.query(query.first, query.second));
+        ASSERT_EQ(*min_element(first, last), minimums.query(query.first, query.second));
+        ASSERT_EQ(*max_element(first, last), maximums.query(query.first, query.second));
+    }
+}
+
+TEST(RangeUpdates, MatchVectorForSumMinAndMax){
+    mt19937 random(2);
+    for (size_t n : test_sizes){
+        vector<long long> elements(n);
+        generate(elements.begin(), elements.end(), [&random] () { return (long long)(random() % 200) - 100; });
+        SegmentTree<long long> sums(elements);
+        SegmentTree<long long, MinOperation<long long>> minimums(elements);
+        SegmentTree<long long, MaxOperation<long long>> maximums(elements);
+        checkRangeUpdates(n, random, sums, minimums, maximums, elements);
+
+        //after a flush the leaves hold every update, and later updates still apply
+        sums.flush();
+        minimums.flush();
+        maximums.flush();
+        for (size_t i = 0; i < n; ++i){
+            ASSERT_EQ(elements[i], sums.sum(i, i));
+            ASSERT_EQ(elements[i], minimums.query(i, i));
+        }
+        checkRangeUpdates(n, random, sums, minimums, maximums, elements);
+    }
+}
+
+TEST(RangeUpdates, AffineComposition){
+    SegmentTree<long long> tree(vector<long long>{1, 2, 3, 4, 5});
+    tree.update(0, 4, AffineUpdate<long long>{2, 1}); //3 5 7 9 11
+    tree.add(1, 3, 10); //3 15 17 19 11
+    tree.update(0, 2, AffineUpdate<long long>{3, -1}); //8 44 50 19 11
+    ASSERT_EQ(8, tree.sum(0, 0));
+    ASSERT_EQ(94, tree.sum(1, 2));
+    ASSERT_EQ(132, tree.sum(0, 4));
+    tree.assign(2, 4, 0);
+    ASSERT_EQ(52, tree.sum(0, 4));
+    tree.set(3, 6);
+    ASSERT_EQ(58, tree.sum(0, 4));
+    ASSERT_EQ(6, tree.sum(2, 3));
+}
+
+long long plainGcd(long long first, long long second){
+    first = first < 0 ? -first : first;
+    second = second < 0 ? -second : second;
+    while (second != 0){
+        long long rest = first % second;
+        first = second;
+        second = rest;
+    }
+    return first;
+}
+
+TEST(Operations, GcdOfMixedSigns){
+    mt19937 random(6);
+    for (size_t n : test_sizes){
+        vector<long long> elements(n);
+        generate(elements.begin(), elements.end(), [&random] () { return ((long long)(random() % 21) - 10) * 6; });
+        SegmentTree<long long, GcdOperation<long long>> tree(elements);
+        for (int i = 0; i < 1000; ++i){
+            size_t index = random() % n;
+            elements[index] = ((long long)(random() % 21) - 10) * (random() % 2 ? 4 : 6);
+            tree.set(index, elements[index]);
+            auto range = randomRange(random, n);
+            long long expected = 0;
+            for (size_t k = range.first; k <= range.second; ++k){
+                expected = plainGcd(expected, elements[k]);
+            }
+            ASSERT_EQ(expected, tree.query(range.first, range.second));
+        }
+    }
+
+    SegmentTree<int, GcdOperation<int>> negative(vector<int>{-12, -18});
+    ASSERT_EQ(6, negative.query(0, 1));
+    ASSERT_EQ(12, negative.query(0, 0));
+    SegmentTree<unsigned, GcdOperation<unsigned>> unsigned_tree(vector<unsigned>{12, 18, 0, 27});
+    ASSERT_EQ(3u, unsigned_tree.query(0, 3));
+    ASSERT_EQ(0u, unsigned_tree.query(2, 2));
+}
+
+TEST(Operations, ArgMaxTiesTakeLeftmost){
+    mt19937 random(7);
+    for (size_t n : test_sizes){
+        vector<pair<int, size_t>> elements(n);
+        for (size_t i = 0; i < n; ++i){
+            elements[i] = make_pair(int(random() % 4), i);
+        }
+        SegmentTree<pair<int, size_t>, ArgMaxOperation<int>> tree(elements);
+        for (int i = 0; i < 1000; ++i){
+            size_t index = random() % n;
+            elements[index].first = random() % 4;
+            tree.set(index, elements[index]);
+            auto range = randomRange(random, n);
+            //max_element returns the first of equal maxima
+            auto expected = *max_element(elements.begin() + range.first, elements.begin() + range.second + 1,
+                                         [](const pair<int, size_t> &first, const pair<int, size_t> &second){
+                                             return first.first < second.first;
+                                         });
+            ASSERT_EQ(expected, tree.query(range.first, range.second));
+        }
+    }
+
+    SegmentTree<pair<int, size_t>, ArgMaxOperation<int>> equal(vector<pair<int, size_t>>{{5, 0}, {5, 1}, {5, 2}});
+    ASSERT_EQ(0, equal.query(0, 2).second);
+    ASSERT_EQ(1, equal.query(1, 2).second);
+}
+
+const unsigned long long matrix_modulus = 1000000007;
+
+//2x2 matrices modulo a prime, their product is not commutative
+struct Matrix{
+    unsigned long long a, b, c, d;
+
+    bool operator==(const Matrix &other) const { return a == other.a && b == other.b && c == other.c && d == other.d; }
+};
+
+//multiplies every element of a range by factor
+struct ScaleUpdate{
+    unsigned long long factor = 1;
+
+    ScaleUpdate after(const ScaleUpdate &inner) const { return ScaleUpdate{factor * inner.factor % matrix_modulus}; }
+
+    bool isIdentity() const { return factor == 1; }
+};
+
+struct MatrixProduct{
+    using update_type = ScaleUpdate;
+
+    static constexpr Matrix identity() { return Matrix{1, 0, 0, 1}; }
+
+    Matrix operator()(const Matrix &left, const Matrix &right) const {
+        return Matrix{(left.a * right.a + left.b * right.c) % matrix_modulus, (left.a * right.b + left.b * right.d) % matrix_modulus,
+                      (left.c * right.a + left.d * right.c) % matrix_modulus, (left.c * right.b + left.d * right.d) % matrix_modulus};
+    }
+
+    //the product of length scaled matrices is scaled by factor to the power of length
+    Matrix apply(const ScaleUpdate &update, const Matrix &product, size_t length) const {
+        unsigned long long scale = 1;
+        for (size_t i = 0; i < length; ++i){
+            scale = scale * update.factor % matrix_modulus;
+        }
+        return Matrix{product.a * scale % matrix_modulus, product.b * scale % matrix_modulus,
+                      product.c * scale % matrix_modulus, product.d * scale % matrix_modulus};
+    }
+};
+
+TEST(Operations, MatrixProductKeepsOrder){
+    mt19937 random(8);
+    auto randomMatrix = [&random] () { return Matrix{random() % 10, random() % 10, random() % 10, random() % 10}; };
+    for (size_t n : test_sizes){
+        vector<Matrix> elements(n);
+        generate(elements.begin(), elements.end(), randomMatrix);
+        SegmentTree<Matrix, MatrixProduct> tree(elements);
+        for (int i = 0; i < 300; ++i){
+            //the first half runs without range updates, bottom up, the second half with them waiting at inner nodes
+            auto range = randomRange(random, n);
+            if (i >= 150 && random() % 2){
+                ScaleUpdate update{random() % 5 + 2};
+                for (size_t k = range.first; k <= range.second; ++k){
+                    elements[k] = MatrixProduct().apply(update, elements[k], 1);
+                }
+                tree.update(range.first, range.second, update);
+            }
+            else{
+                elements[range.first] = randomMatrix();
+                tree.set(range.first, elements[range.first]);
+            }
+
+            auto query = randomRange(random, n);
+            Matrix expected = MatrixProduct::identity();
+            for (size_t k = query.first; k <= query.second; ++k){
+                expected = MatrixProduct()(expected, elements[k]);
+            }
+            ASSERT_TRUE(expected == tree.query(query.first, query.second));
+        }
+    }
+}
+
+//first index from left_border to right_border where the running sum reaches value, n if none
+size_t plainFindPrefix(const vector<long long> &elements, size_t left_border, size_t right_border, long long value){
+    long long sum = 0;
+    for (size_t i = left_border; i <= right_border; ++i){
+        sum += elements[i];
+        if (sum >= value){
+            return i;
+        }
+    }
+    return elements.size();
+}
+
+TEST(DescentSearch, PrefixOfSumTree){
+    mt19937 random(3);
+    for (size_t n : test_sizes){
+        vector<long long> elements(n);
+        generate(elements.begin(), elements.end(), [&random] () { return (long long)(random() % 10); });
+        SegmentTree<long long> tree(elements);
+        for (int i = 0; i < 1000; ++i){
+            if (i == 500){
+                //the same checks with updates waiting at inner nodes
+                auto range = randomRange(random, n);
+                for (size_t k = range.first; k <= range.second; ++k){
+                    elements[k] += 3;
+                }
+                tree.add(range.first, range.second, 3);
+            }
+            long long total = plainSum(elements, 0, n - 1);
+            for (long long target : {0LL, total, total + 1, (long long)(random() % (total + 1))}){
+                ASSERT_EQ(plainFindPrefix(elements, 0, n - 1, target), tree.findPrefix(target));
+            }
+            ASSERT_EQ(0, tree.findPrefix(0));
+            ASSERT_EQ(n, tree.findPrefix(total + 1));
+
+            auto range = randomRange(random, n);
+            long long target = random() % (plainSum(elements, range.first, range.second) + 2);
+            ASSERT_EQ(plainFindPrefix(elements, range.first, range.second, target),
+                      tree.findAtLeast(range.first, range.second, target));
+        }
+    }
+
+    SegmentTree<long long> empty(vector<long long>{});
+    ASSERT_EQ(0, empty.findPrefix(1));
+}
+
+TEST(DescentSearch, FirstAtLeastInMaxTree){
+    mt19937 random(4);
+    for (size_t n : test_sizes){
+        vector<long long> elements(n);
+        generate(elements.begin(), elements.end(), [&random] () { return (long long)(random() % 100); });
+        SegmentTree<long long, MaxOperation<long long>> tree(elements);
+        for (int i = 0; i < 1000; ++i){
+            if (i % 100 == 50){
+                auto range = randomRange(random, n);
+                long long value = random() % 100;
+                for (size_t k = range.first; k <= range.second; ++k){
+                    elements[k] = value;
+                }
+                tree.assign(range.first, range.second, value);
+            }
+            auto range = randomRange(random, n);
+            long long bound = random() % 110;
+            auto first = elements.begin() + range.first;
+            auto last = elements.begin() + range.second + 1;
+            auto found = find_if(first, last, [bound](long long element) { return element >= bound; });
+            size_t expected = found == last ? n : size_t(found - elements.begin());
+            ASSERT_EQ(expected, tree.findAtLeast(range.first, range.second, bound));
+            //nothing is above the maximum
+            ASSERT_EQ(n, tree.findAtLeast(range.first, range.second, *max_element(first, last) + 1));
+        }
+
+        //generic predicate: first index where the maximum so far exceeds the one of the first element
+        auto predicate = [&elements](long long maximum) { return maximum > elements[0]; };
+        auto found = find_if(elements.begin(), elements.end(), [&elements](long long element) { return element > elements[0]; });
+        ASSERT_EQ(size_t(found - elements.begin()), tree.findFirst(0, n - 1, predicate));
+    }
+}
+
+TEST(Batches, QueryBatchMatchesQueries){
+    mt19937 random(5);
+    for (size_t n : test_sizes){
+        vector<long long> elements(n);
+        generate(elements.begin(), elements.end(), [&random] () { return (long long)(random() % 200) - 100; });
+        SegmentTree<long long> tree(elements);
+        SegmentTree<long long, MinOperation<long long>> minimums(elements);
+        tree.add(0, n - 1, 1);
+        for (auto &element : elements){
+            ++element;
+        }
+
+        ASSERT_TRUE(tree.queryBatch({}).empty());
+        //small batches stay on the calling thread, large ones are split into chunks
+        for (size_t count : {size_t(1), size_t(10), size_t(3 * 4096 + 17)}){
+            vector<pair<size_t, size_t>> ranges(count);
+            generate(ranges.begin(), ranges.end(), [&random, n] () { return randomRange(random, n); });
+            for (unsigned threads : {1u, 4u, 0u}){
+                auto sums = tree.queryBatch(ranges, threads);
+                auto mins = minimums.queryBatch(ranges, threads);
+                ASSERT_EQ(count, sums.size());
+                for (size_t i = 0; i < count; ++i){
+                    ASSERT_EQ(plainSum(elements, ranges[i].first, ranges[i].second), sums[i]);
+                    ASSERT_EQ(*min_element(elements.begin() + ranges[i].first, elements.begin() + ranges[i].second + 1) - 1,
+                              mins[i]);
+                }
+            }
+        }
+    }
+}
+
+TEST(Batches, UpdateBatchMatchesSets){
+    mt19937 random(6);
+    for (size_t n : test_sizes){
+        vector<long long> elements(n);
+        generate(elements.begin(), elements.end(), [&random] () { return (long long)(random() % 200) - 100; });
+        SegmentTree<long long> tree(elements);
+        SegmentTree<long long, MaxOperation<long long>> maximums(elements);
+        tree.updateBatch({});
+        for (int i = 0; i < 200; ++i){
+            if (i % 50 == 25){
+                auto range = randomRange(random, n);
+                for (size_t k = range.first; k <= range.second; ++k){
+                    elements[k] += 7;
+                }
+                tree.add(range.first, range.second, 7);
+                maximums.add(range.first, range.second, 7);
+            }
+            //few distinct indices, so repeated ones are common
+            vector<pair<size_t, long long>> assignments(random() % 40);
+            for (auto &assignment : assignments){
+                assignment = make_pair(random() % min<size_t>(n, 16), (long long)(random() % 200) - 100);
+                elements[assignment.first] = assignment.second;
+            }
+            tree.updateBatch(assignments);
+            maximums.updateBatch(assignments);
+            for (size_t k = 0; k < n; ++k){
+                ASSERT_EQ(elements[k], tree.sum(k, k));
+            }
+            auto range = randomRange(random, n);
+            ASSERT_EQ(plainSum(elements, range.first, range.second), tree.sum(range.first, range.second));
+            ASSERT_EQ(*max_element(elements.begin() + range.first, elements.begin() + range.second + 1),
+                      maximums.query(range.first, range.second));
+        }
+    }
+}
+
+TEST(Batches, RepeatedIndexLastWins){
+    SegmentTree<long long> single(vector<long long>{5});
+    single.updateBatch({{0, 1}, {0, 2}, {0, 3}});
+    ASSERT_EQ(3, single.sum(0, 0));
+    ASSERT_EQ(vector<long long>{3}, single.queryBatch({{0, 0}}));
+
+    SegmentTree<long long> tree(vector<long long>{1, 2, 3, 4, 5});
+    tree.updateBatch({{4, 10}, {1, 20}, {4, 30}, {1, 40}, {4, 50}});
+    ASSERT_EQ(vector<long long>({1, 40, 3, 4, 50}), tree.queryBatch({{0, 0}, {1, 1}, {2, 2}, {3, 3}, {4, 4}}));
+    ASSERT_EQ(98, tree.sum(0, 4));
+}